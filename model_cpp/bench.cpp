@@ -0,0 +1,236 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <map>
+#include <vector>
+#include "controller.h"
+
+/*
+ * Benchmarks of the 2D simulation, built on Google Benchmark: "make bench" builds them and "make bench-json" runs them
+ * and writes the results to bench.json.
+ *
+ * The kernels (BM_Diffuse, BM_CycleCells...) are timed on square grids of each of the grid_sizes, the same for all of
+ * them so that their results can be compared, that have gone through the 350 ticks of growth preceding a treatment,
+ * with the same density of cells and sources as the default 50x50 grid. The kernels that change the cells run on a copy
+ * of this grid made before each iteration, outside of the timing. The scenarios (BM_Warmup, BM_Treatment...) time whole
+ * runs of the Controller.
+ */
+
+static const int warmup_ticks = 350;
+
+static const std::vector<int64_t> grid_sizes = {50, 100, 200, 400};
+
+/**
+ * Run a benchmark once for each of the grid_sizes
+ */
+static void on_grid_sizes(benchmark::internal::Benchmark * bench){
+    for (int64_t size : grid_sizes)
+        bench -> Arg(size);
+}
+
+/**
+ * Healthy cells and sources of a square grid, proportional to its area (1000 cells and 50 sources for 50x50 pixels)
+ */
+static int grid_hcells(int size){
+    return size * size * 2 / 5;
+}
+
+static int grid_sources(int size){
+    return size * size / 50;
+}
+
+struct WarmState {
+    Grid * grid;
+    Controller * controller; // Controller of grid, which does not own it
+};
+
+/**
+ * Simulation of a size after the warmup ticks, created the first time it is needed and kept for all the benchmarks
+ */
+static WarmState & warm_state(int size){
+    static std::map<int, WarmState> states;
+    WarmState & state = states[size];
+    if (!state.grid){
+        state.grid = new Grid(size, size, grid_sources(size), 42);
+        state.controller = new Controller(state.grid, grid_hcells(size), size, size);
+        for (int i = 0; i < warmup_ticks; i++)
+            state.controller -> go();
+    }
+    return state;
+}
+
+static Grid * warm_grid(int size){
+    return warm_state(size).grid;
+}
+
+/**
+ * Time a kernel that changes the cells on a fresh copy of a warm grid
+ */
+template <typename Kernel>
+static void run_on_copies(benchmark::State & state, Grid * warm, Kernel kernel){
+    for (auto _ : state){
+        state.PauseTiming();
+        Grid * grid = new Grid(*warm);
+        state.ResumeTiming();
+        kernel(grid);
+        state.PauseTiming();
+        delete grid;
+        state.ResumeTiming();
+    }
+}
+
+static void BM_Diffuse(benchmark::State & state){
+    Grid * grid = warm_grid((int) state.range(0));
+    for (auto _ : state)
+        grid -> diffuse(0.2);
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+}
+BENCHMARK(BM_Diffuse)->Apply(on_grid_sizes);
+
+static void BM_CycleCells(benchmark::State & state){
+    Grid * warm = warm_grid((int) state.range(0));
+    int threads = (int) state.range(1);
+    warm -> set_cycle_threads(threads, 16);
+    run_on_copies(state, warm, [](Grid * grid){
+        grid -> cycle_cells();
+    });
+    warm -> set_cycle_threads(1, 16);
+    state.SetItemsProcessed(state.iterations() * state.range(0) * state.range(0));
+}
+BENCHMARK(BM_CycleCells)->ArgsProduct({grid_sizes, {1, 4}});
+
+static void BM_Irradiate(benchmark::State & state){
+    Grid * warm = warm_grid((int) state.range(0));
+    run_on_copies(state, warm, [](Grid * grid){
+        grid -> irradiate(2.0);
+    });
+}
+BENCHMARK(BM_Irradiate)->Apply(on_grid_sizes);
+
+// Constant time, from the sums of the positions of the cancer cells kept by the CellStore of the grid
+static void BM_ComputeCenter(benchmark::State & state){
+    Grid * grid = warm_grid((int) state.range(0));
+    for (auto _ : state){
+        grid -> compute_center();
+        benchmark::DoNotOptimize(grid -> get_center_x());
+    }
+}
+BENCHMARK(BM_ComputeCenter)->Apply(on_grid_sizes);
+
+static void BM_TumorRadius(benchmark::State & state){
+    int size = (int) state.range(0);
+    Grid * warm = warm_grid(size);
+    // On copies, as the radius is cached until the cells change
+    run_on_copies(state, warm, [size](Grid * grid){
+        benchmark::DoNotOptimize(grid -> tumor_radius(size / 2, size / 2));
+    });
+}
+BENCHMARK(BM_TumorRadius)->Apply(on_grid_sizes);
+
+/*
+ * Marshalling of the observations, as done by the observe* functions of the Python module (see model.cpp) without the
+ * allocation of the numpy arrays
+ */
+
+static void BM_ObserveDensity(benchmark::State & state){
+    int size = (int) state.range(0);
+    Grid * grid = warm_grid(size);
+    std::vector<int> out(size * size);
+    for (auto _ : state){
+        for (int x = 0; x < size * size; x++)
+            out[x] = grid -> pixel_density(x / size, x % size);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ObserveDensity)->Apply(on_grid_sizes);
+
+static void BM_ObserveSegmentation(benchmark::State & state){
+    int size = (int) state.range(0);
+    Grid * grid = warm_grid(size);
+    std::vector<int> out(size * size);
+    for (auto _ : state){
+        for (int x = 0; x < size * size; x++)
+            out[x] = grid -> pixel_type(x / size, x % size);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ObserveSegmentation)->Apply(on_grid_sizes);
+
+static void BM_ObserveGlucose(benchmark::State & state){
+    int size = (int) state.range(0);
+    Grid * grid = warm_grid(size);
+    FieldView<double> glucose = grid -> currentGlucose();
+    std::vector<double> out(size * size);
+    for (auto _ : state){
+        for (int i = 0; i < size; i++)
+            std::memcpy(out.data() + i * size, glucose[i], size * sizeof(double));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ObserveGlucose)->Apply(on_grid_sizes);
+
+static void BM_ObserveState(benchmark::State & state){
+    int size = (int) state.range(0);
+    Controller * controller = warm_state(size).controller;
+    const double scales[3] = {1.0, 1.0 / 100.0, 1.0 / 1000.0};
+    std::vector<float> out(size * size * 3);
+    for (auto _ : state){
+        controller -> observe_state(out.data(), scales);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ObserveState)->Apply(on_grid_sizes);
+
+/*
+ * End-to-end scenarios
+ */
+
+static void BM_Warmup(benchmark::State & state){
+    int size = (int) state.range(0);
+    for (auto _ : state){
+        Controller controller(grid_hcells(size), size, size, grid_sources(size), 42);
+        for (int i = 0; i < warmup_ticks; i++)
+            controller.go();
+        benchmark::DoNotOptimize(controller.ccell_count());
+    }
+}
+BENCHMARK(BM_Warmup)->Apply(on_grid_sizes)->Unit(benchmark::kMillisecond);
+
+/**
+ * The 35 fractions of 2 Gy of the baseline treatment, one a day, on a warm grid
+ */
+static void BM_Treatment(benchmark::State & state){
+    int size = (int) state.range(0);
+    Grid * warm = warm_grid(size);
+    run_on_copies(state, warm, [](Grid * grid){
+        for (int fraction = 0; fraction < 35; fraction++){
+            grid -> irradiate(2.0);
+            for (int hour = 0; hour < 24; hour++){
+                grid -> fill_sources(130, 4500);
+                grid -> cycle_cells();
+                grid -> diffuse(0.2);
+                if (hour == 23)
+                    grid -> compute_center();
+            }
+        }
+    });
+}
+BENCHMARK(BM_Treatment)->Apply(on_grid_sizes)->Unit(benchmark::kMillisecond);
+
+/**
+ * The canonical run of the controller executable (see controller_main.cpp): an OAR zone, 2000 ticks, and a fraction of
+ * 2 Gy every day after the first 400 ticks
+ */
+static void BM_OARTreatment(benchmark::State & state){
+    for (auto _ : state){
+        Controller controller(1000, 50, 50, 50, 5, 15, 5, 15, 42);
+        for (int i = 1; i <= 2000; i++){
+            controller.go();
+            if (i > 400 && i % 24 == 0)
+                controller.irradiate(2.0);
+        }
+        benchmark::DoNotOptimize(controller.ccell_count());
+    }
+}
+BENCHMARK(BM_OARTreatment)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
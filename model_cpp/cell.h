@@ -1,12 +1,22 @@
 #ifndef RADIO_RL_CELL_H
 #define RADIO_RL_CELL_H
 
+#include "sim_context.h"
+
+template <typename T> class SurvivalTable;
+
 typedef struct {
     double glucose;
     double oxygen;
     char new_cell;
 } cell_cycle_res;
 
+/*
+ * The behaviour of each type of cell is written as static "kernels" that work on the state of a single cell passed by
+ * reference, so that it can be shared between the Cell objects below and the structure-of-arrays storage of the Grid
+ * (see cell_store.h). A kernel marks a cell as dead by setting its stage to 'd'. The kernels are defined in
+ * cell_kernels.h, which must be included wherever they are called.
+ */
 class Cell {
 protected:
     short age;
@@ -16,41 +26,59 @@ public:
     bool alive;
     Cell(char stage);
     virtual ~Cell()=default;
-    virtual cell_cycle_res cycle(double glucose, double oxygen, int count) = 0;
-    virtual void radiate(double dose) = 0;
+    virtual cell_cycle_res cycle(double glucose, double oxygen, int count, SimContext * ctx) = 0;
+    virtual void radiate(double dose, SimContext * ctx) = 0;
     void sleep();
     void wake();
+    static void sleep(char & stage, short & age);
+    static void wake(char & stage, short & age);
+    static void draw_efficiency(double & glu_efficiency, double & oxy_efficiency, SimContext * ctx);
 };
 
-class HealthyCell : public Cell{
+class HealthyCell final : public Cell{
 public:
-    static int count;
-    HealthyCell(char stage);
+    HealthyCell(char stage, SimContext * ctx);
     //~HealthyCell();
-    cell_cycle_res cycle(double glucose, double oxygen, int neigh_count) override;
-    void radiate(double dose) override;
+    cell_cycle_res cycle(double glucose, double oxygen, int neigh_count, SimContext * ctx) override;
+    void radiate(double dose, SimContext * ctx) override;
+    void radiate(SurvivalTable<HealthyCell> & survival, const double * draws, SimContext * ctx);
+    static inline cell_cycle_res cycle_kernel(char & stage, short & age, short & repair, double glu_efficiency,
+                                              double oxy_efficiency, double glucose, double oxygen, int neigh_count,
+                                              SimContext * ctx);
+    static inline double survival_probability(char stage, double dose);
+    static inline void radiate_kernel(char & stage, short & repair, double survival, double dose, const double * draws,
+                                      SimContext * ctx);
 private:
     double glu_efficiency;
     double oxy_efficiency;
 };
 
-class CancerCell : public Cell{
+class CancerCell final : public Cell{
 public:
-    static int count;
-    CancerCell(char stage);
+    CancerCell(char stage, SimContext * ctx);
     //~CancerCell();
-    cell_cycle_res cycle(double glucose, double oxygen, int neigh_count) override;
-    void radiate(double dose) override;
+    cell_cycle_res cycle(double glucose, double oxygen, int neigh_count, SimContext * ctx) override;
+    void radiate(double dose, SimContext * ctx) override;
+    void radiate(SurvivalTable<CancerCell> & survival, const double * draws, SimContext * ctx);
+    static inline cell_cycle_res cycle_kernel(char & stage, short & age, short & repair, double efficiency_draw,
+                                              double glucose, double oxygen, int neigh_count, SimContext * ctx);
+    static inline double survival_probability(char stage, double dose);
+    static inline void radiate_kernel(char & stage, short & repair, double survival, double dose, const double * draws,
+                                      SimContext * ctx);
 };
 
-class OARCell : public Cell{
+class OARCell final : public Cell{
 public:
-    static int count;
     static int worth;
-    OARCell(char stage);
+    OARCell(char stage, SimContext * ctx);
     //~CancerCell();
-    cell_cycle_res cycle(double glucose, double oxygen, int neigh_count) override;
-    void radiate(double dose) override;
+    cell_cycle_res cycle(double glucose, double oxygen, int neigh_count, SimContext * ctx) override;
+    void radiate(double dose, SimContext * ctx) override;
+    void radiate(SurvivalTable<OARCell> & survival, const double * draws, SimContext * ctx);
+    static inline cell_cycle_res cycle_kernel(char & stage, short & age, double glu_efficiency, double oxy_efficiency,
+                                              double glucose, double oxygen, int neigh_count, SimContext * ctx);
+    static inline double survival_probability(char stage, double dose);
+    static inline void radiate_kernel(char & stage, double survival, const double * draws, SimContext * ctx);
 private:
     double glu_efficiency;
     double oxy_efficiency;
@@ -0,0 +1,484 @@
+#ifndef RADIO_RL_CELL_KERNELS_H
+#define RADIO_RL_CELL_KERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "cell.h"
+
+/*
+ * Definitions of the kernels declared in cell.h, kept in a header so that they can be inlined in the loops that call
+ * them (see Grid::cycle_run) instead of being called once per cell and per hour.
+ */
+
+constexpr float quiescent_glucose_level = 17.28; // 1.728 E-7 mg/cell O'Neil
+//static float max_glucose_absorption = .72; //
+constexpr float average_glucose_absorption = .36; // 3.6E-9 mg/cell/hour O'Neil
+constexpr float average_cancer_glucose_absorption = .54; // 5.4 E-9 mg/cell/hour O'Neil
+constexpr int critical_neighbors = 9; // Density to get one cell per pixel, O'Neil
+constexpr float critical_glucose_level = 6.48; //6.48 E-8 mg/cell O'Neil
+constexpr float alpha_tumor = 0.3; // Powathil
+constexpr float beta_tumor = 0.03; // Powathil
+constexpr float alpha_norm_tissue = 0.15;
+constexpr float beta_norm_tissue = 0.03;
+constexpr float alpha_oar = 0.03;
+constexpr float beta_oar = 0.009;
+constexpr int repair_time = 9;
+constexpr float average_oxygen_consumption = 20.0; // 2.16 E-9 ml/cell/hour Jalalimanesh
+//static float max_oxygen_consumption = 40.0; // 4.32 E-9 ml/cell/hour Jalalimanesh
+constexpr float critical_oxygen_level = 360.0; // 3.88 E-8 ml/cell/hour Jalalimanesh
+constexpr float quiescent_oxygen_level = 960.0; // 10.37 E-8 ml/cell/hour Jalalimanesh
+
+/**
+ * A stage of the cell cycle and the number of hours a cell spends in it before moving on to the next one
+ */
+struct CycleStage {
+    char stage;
+    short hours;
+};
+
+constexpr CycleStage cycle_stages[] = {{'1', 11}, {'s', 8}, {'2', 4}, {'m', 1}}; // Gap 1, synthesis, gap 2, mitosis
+
+/**
+ * Look up a stage in cycle_stages at compile time
+ *
+ * @param stage The stage, which must be in cycle_stages
+ * @param k The first entry of the table to search
+ */
+constexpr const CycleStage & cycle_stage(char stage, int k = 0){
+    return cycle_stages[k].stage == stage ? cycle_stages[k] : cycle_stage(stage, k + 1);
+}
+
+constexpr short gap1_hours = cycle_stage('1').hours;
+constexpr short synthesis_hours = cycle_stage('s').hours;
+constexpr short gap2_hours = cycle_stage('2').hours;
+constexpr short mitosis_hours = cycle_stage('m').hours;
+
+/**
+ * Index of a stage in the survival probabilities of a SurvivalTable
+ */
+inline int survival_slot(char stage){
+    switch (stage){
+        case '1':
+            return 0;
+        case 's':
+            return 1;
+        case '2':
+            return 2;
+        case 'm':
+            return 3;
+        case 'q':
+            return 4;
+        default:
+            return 5;
+    }
+}
+
+/**
+ * Survival probabilities of the cells of type T to a single dose of radiation, computed for each stage the first time
+ * they are needed, so that cells sharing a dose do not compute them once each
+ */
+template <typename T>
+class SurvivalTable {
+public:
+    explicit SurvivalTable(double dose);
+    double dose();
+    double at(char stage);
+private:
+    double dose_value;
+    double probability[6]; // Negative until computed, indexed by survival_slot
+};
+
+template <typename T>
+inline SurvivalTable<T>::SurvivalTable(double dose): dose_value(dose) {
+    for (int k = 0; k < 6; k++)
+        probability[k] = -1.0;
+}
+
+template <typename T>
+inline double SurvivalTable<T>::dose(){
+    return dose_value;
+}
+
+template <typename T>
+inline double SurvivalTable<T>::at(char stage){
+    double & p = probability[survival_slot(stage)];
+    if (p < 0.0)
+        p = T::survival_probability(stage, dose_value);
+    return p;
+}
+
+/**
+ * Simulates one hour of the cell cycle for a healthy cell
+ *
+ * Verifies that the cell has enough nutrients (otherwise it dies), and advances the cell one hour in the cycle,
+ * changing its stage if necessary.
+ *
+ * @param stage Stage of the cell, set to 'd' if it dies
+ * @param age Time spent by the cell in its current stage
+ * @param repair Remaining hours of repair of the cell after irradiation
+ * @param glu_efficiency Glucose consumed by the cell per hour
+ * @param oxy_efficiency Oxygen consumed by the cell per hour
+ * @param glucose Amount of glucose available to the cell
+ * @param oxygen Amount of oxygen available to the cell
+ * @param neigh_count Number of cells in neigbouring pixels on the grid
+ * @param ctx The context of the simulation the cell belongs to
+ * @return A cell_cycle_res object that contains the amount of glucose and oxygen consumed as well as a character that
+ *         indicates if a new healthy cell has to be created and its type.
+ */
+inline cell_cycle_res HealthyCell::cycle_kernel(char & stage, short & age, short & repair, double glu_efficiency,
+                                                double oxy_efficiency, double glucose, double oxygen, int neigh_count,
+                                                SimContext * ctx) {
+    cell_cycle_res result = {.0,.0,'\0'};
+    if(repair == 0)
+        age++;
+    else
+        repair--;
+    if (glucose < critical_glucose_level || oxygen < critical_oxygen_level) { //Check if the cell will survive this hour
+        stage = 'd';
+        ctx -> hcell_count--;
+        return result;
+    }
+    switch(stage){
+        case 'q': //Quiescence
+            result.glucose = glu_efficiency * .75;
+            result.oxygen  = oxy_efficiency * .75;
+            if (glucose > quiescent_glucose_level && neigh_count < critical_neighbors && oxygen > quiescent_oxygen_level){
+                age = 0;
+                stage = '1'; // gap 1
+            }
+            break;
+        case 'm': //Mitosis
+            if (age == mitosis_hours){
+                stage = '1';
+                age = 0;
+                result.new_cell = 'h';
+            }
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            break;
+        case '2': //Gap 2
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (age == gap2_hours){
+                age = 0;
+                stage = 'm';
+            }
+            break;
+        case 's': //Synthesis
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (age == synthesis_hours){
+                age = 0;
+                stage = '2';
+            }
+            break;
+        case '1': //Gap 1
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (glucose < quiescent_glucose_level || neigh_count >= critical_neighbors || oxygen < quiescent_oxygen_level){
+                age = 0;
+                stage = 'q';
+            } else if(age >= gap1_hours) {
+                age = 0;
+                stage = 's';
+            }
+            break;
+        default:
+            std::cout << "INCORRECT CELL STAGE " << stage << std::endl;
+            break;
+    }
+    return result;
+}
+
+/**
+ * Probability that a HealthyCell survives a dose of radiation, with a modified LQ model
+ *
+ * @param stage Stage of the cell, which sets its radiosensitivity
+ * @param dose Radiation dose in grays
+ */
+inline double HealthyCell::survival_probability(char stage, double dose) {
+    float radio_gamma = 0.0;
+    switch (stage){
+        case '2':
+            radio_gamma = 1.25;
+            break;
+        case 'm':
+            radio_gamma = 1.25;
+            break;
+        case '1':
+            radio_gamma = 1.0;
+            break;
+        case 'q':
+            radio_gamma = 0.75;
+            break;
+        case 's':
+            radio_gamma = 0.75;
+            break;
+        default:
+            radio_gamma = 1.0;
+            break;
+    }
+    return std::exp(radio_gamma * ( - (alpha_norm_tissue * dose) - (beta_norm_tissue * dose * dose)));
+}
+
+/**
+ * Simulates the effect of radiation on a  HealthyCell
+ *
+ * Probabilistically decides if the cell survives or not to the radiation
+ *
+ * @param stage Stage of the cell, set to 'd' if it dies
+ * @param repair Remaining hours of repair of the cell, increased if it survives
+ * @param survival Probability that the cell survives, see survival_probability
+ * @param dose Radiation dose in grays
+ * @param draws Two draws from [0, 1), deciding whether the cell survives and how long it takes to repair
+ * @param ctx The context of the simulation the cell belongs to
+ */
+inline void HealthyCell::radiate_kernel(char & stage, short & repair, double survival, double dose,
+                                        const double * draws, SimContext * ctx) {
+    if (draws[0] > survival){
+        stage = 'd';
+        ctx -> hcell_count--;
+    } else if (dose > 0.5){
+        repair += (int) std::round(2.0 * draws[1] * (double) repair_time );
+    }
+}
+
+
+/**
+ * Probability that a CancerCell survives a dose of radiation, with a modified LQ model
+ *
+ * @param stage Stage of the cell, which sets its radiosensitivity
+ * @param dose Radiation dose in grays
+ */
+inline double CancerCell::survival_probability(char stage, double dose) {
+    float radio_gamma = 0.0;
+    switch (stage){
+        case '2':
+            radio_gamma = 1.25;
+            break;
+        case 'm':
+            radio_gamma = 1.25;
+            break;
+        case '1':
+            radio_gamma = 1.0;
+            break;
+        case 's':
+            radio_gamma = 0.75;
+            break;
+        default:
+            radio_gamma = 1.0;
+            break;
+    }
+    return std::exp(radio_gamma *  (- (alpha_tumor * dose) - (beta_tumor * dose * dose)));
+}
+
+/**
+ * Simulates the effect of radiation on a CancerCell
+ *
+ * Probabilistically decides if the cell survives or not to the radiation
+ *
+ * @param stage Stage of the cell, set to 'd' if it dies
+ * @param repair Remaining hours of repair of the cell, increased if it survives
+ * @param survival Probability that the cell survives, see survival_probability
+ * @param dose Radiation dose in grays
+ * @param draws Two draws from [0, 1), deciding whether the cell survives and how long it takes to repair
+ * @param ctx The context of the simulation the cell belongs to
+ */
+inline void CancerCell::radiate_kernel(char & stage, short & repair, double survival, double dose, const double * draws,
+                                       SimContext * ctx) {
+    if (draws[0] > survival){
+        stage = 'd';
+        ctx -> ccell_count--;
+    } else if (dose > 0.5){
+        repair += (int) std::round(2.0 * draws[1] * (double) repair_time );
+    }
+}
+
+
+/**
+ * Simulates one hour of the cell cycle for a cancer cell
+ *
+ * Verifies that the cell has enough nutrients (otherwise it dies), and advances the cell one hour in the cycle,
+ * changing its stage if necessary.
+ *
+ * @param stage Stage of the cell, set to 'd' if it dies
+ * @param age Time spent by the cell in its current stage
+ * @param repair Remaining hours of repair of the cell after irradiation
+ * @param efficiency_draw Draw from SimContext::norm setting the nutrients consumed by the cell this hour
+ * @param glucose Amount of glucose available to the cell
+ * @param oxygen Amount of oxygen available to the cell
+ * @param neigh_count Number of cells in neigbouring pixels on the grid
+ * @param ctx The context of the simulation the cell belongs to
+ * @return A cell_cycle_res object that contains the amount of glucose and oxygen consumed as well as a character that
+ *         indicates if a new cancer cell has to be created
+ */
+inline cell_cycle_res CancerCell::cycle_kernel(char & stage, short & age, short & repair, double efficiency_draw,
+                                               double glucose, double oxygen, int neigh_count, SimContext * ctx) {
+    cell_cycle_res result = {.0, .0, '\0'};
+    if(repair == 0)
+        age++;
+    else
+        repair--;
+    if (glucose < critical_glucose_level || oxygen < critical_oxygen_level) {
+        stage = 'd';
+        ctx -> ccell_count--;
+        return result;
+    }
+    double factor = std::max(std::min(efficiency_draw, 2.0), 0.0);
+    double glu_efficiency = factor * average_cancer_glucose_absorption;
+    double oxy_efficiency = factor * average_oxygen_consumption;
+    switch(stage){
+        case 'm': //Mitosis
+            if(age == mitosis_hours){
+                stage = '1';
+                age = 0;
+                result.new_cell = 'c';
+            }
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            break;
+        case '2': //Gap 2
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (age >= gap2_hours){
+                age = 0;
+                stage = 'm';
+            }
+            break;
+        case 's': //Synthesis
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (age >= synthesis_hours){
+                age = 0;
+                stage = '2';
+            }
+            break;
+        case '1': //Gap 1
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if(age >= gap1_hours) {
+                age = 0;
+                stage = 's';
+            }
+            break;
+        default:
+            std::cout << "INCORRECT CELL STAGE " << stage << std::endl;
+            break;
+    }
+    return result;
+}
+
+/**
+ * Simulates one hour of the cell cycle for an OAR cell
+ *
+ * Verifies that the cell has enough nutrients (otherwise it dies), and advances the cell one hour in the cycle,
+ * changing its stage if necessary.
+ *
+ * @param stage Stage of the cell, set to 'd' if it dies
+ * @param age Time spent by the cell in its current stage
+ * @param glu_efficiency Glucose consumed by the cell per hour
+ * @param oxy_efficiency Oxygen consumed by the cell per hour
+ * @param glucose Amount of glucose available to the cell
+ * @param oxygen Amount of oxygen available to the cell
+ * @param neigh_count Number of cells in neigbouring pixels on the grid
+ * @param ctx The context of the simulation the cell belongs to
+ * @return A cell_cycle_res object that contains the amount of glucose and oxygen consumed as well as a character that
+ *         indicates if a new OAR cell has to be created
+ */
+inline cell_cycle_res OARCell::cycle_kernel(char & stage, short & age, double glu_efficiency, double oxy_efficiency,
+                                            double glucose, double oxygen, int neigh_count, SimContext * ctx) {
+    cell_cycle_res result = {.0,.0,'\0'};
+    age++;
+    if (glucose < critical_glucose_level || oxygen < critical_oxygen_level) {
+        stage = 'd';
+        ctx -> oar_count--;
+        result.new_cell = 'w';
+        return result;
+    }
+    switch(stage){
+        case 'q': //Quiescence
+            result.glucose = glu_efficiency * .75;
+            result.oxygen  = oxy_efficiency * .75;
+            break;
+        case 'm': //Mitosis
+            stage = '1';
+            age = 0;
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            result.new_cell = 'o';
+            break;
+        case '2': //Gap 2
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (age == gap2_hours){
+                age = 0;
+                stage = 'm';
+            }
+            break;
+        case 's': //Synthesis
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (age == synthesis_hours){
+                age = 0;
+                stage = '2';
+            }
+            break;
+        case '1': //Gap 1
+            result.glucose = glu_efficiency;
+            result.oxygen = oxy_efficiency;
+            if (glucose < quiescent_glucose_level || neigh_count > critical_neighbors || oxygen < quiescent_oxygen_level){
+                age = 0;
+                stage = 'q';
+            } else if(age >= gap1_hours) {
+                age = 0;
+                stage = 's';
+            }
+            break;
+        default:
+            std::cout << "INCORRECT CELL STAGE " << stage << std::endl;
+            break;
+    }
+    return result;
+}
+
+/**
+ * Probability that a OARCell survives a dose of radiation, with a modified LQ model
+ *
+ * @param stage Stage of the cell, which sets its radiosensitivity
+ * @param dose Radiation dose in grays
+ */
+inline double OARCell::survival_probability(char stage, double dose) {
+    float radio_gamma = 0.0;
+    switch (stage){
+        case '1':
+            radio_gamma = 0.5;
+            break;
+        case 'q':
+            radio_gamma = 0.25;
+            break;
+        default:
+            radio_gamma = 1.0;
+            break;
+    }
+    return std::exp(radio_gamma * ( - (alpha_norm_tissue * dose) - (beta_norm_tissue * dose * dose)));
+}
+
+/**
+ * Simulates the effect of radiation on a OARCell
+ *
+ * Probabilistically decides if the cell survives or not to the radiation
+ *
+ * @param stage Stage of the cell, set to 'd' if it dies
+ * @param survival Probability that the cell survives, see survival_probability
+ * @param draws A draw from [0, 1), deciding whether the cell survives
+ * @param ctx The context of the simulation the cell belongs to
+ */
+inline void OARCell::radiate_kernel(char & stage, double survival, const double * draws, SimContext * ctx) {
+    if (draws[0] > survival){
+        stage = 'd';
+        ctx -> oar_count--;
+    }
+}
+
+#endif //RADIO_RL_CELL_KERNELS_H
@@ -0,0 +1,78 @@
+#include "cell_pool.h"
+#include "grid.h"
+#include <cstddef>
+
+#define SLOTS_PER_SLAB 4096
+
+template <typename T>
+constexpr size_t max_size(){
+    return sizeof(T);
+}
+
+template <typename T, typename U, typename... Rest>
+constexpr size_t max_size(){
+    return sizeof(T) > max_size<U, Rest...>() ? sizeof(T) : max_size<U, Rest...>();
+}
+
+// Every slot can hold any of the objects, and is aligned like memory returned by new
+static const size_t SLOT_ALIGN = alignof(std::max_align_t);
+static const size_t SLOT_SIZE = (max_size<HealthyCell, CancerCell, OARCell, CellNode, void *>() + SLOT_ALIGN - 1)
+                                / SLOT_ALIGN * SLOT_ALIGN;
+
+/**
+ * Constructor of CellPool, slabs are only allocated when needed
+ */
+CellPool::CellPool(): slab(0), used(0), free_list(nullptr) {}
+
+/**
+ * Destructor of CellPool, frees all the slabs without calling the destructors of the objects they still hold
+ */
+CellPool::~CellPool(){
+    for (char * memory : slabs)
+        ::operator delete(memory);
+}
+
+/**
+ * Return an uninitialized slot, large enough for any Cell or CellNode
+ */
+void * CellPool::allocate(){
+    if (free_list){
+        void * slot = free_list;
+        free_list = *(void **) slot;
+        return slot;
+    }
+    if (used == SLOTS_PER_SLAB){
+        slab++;
+        used = 0;
+    }
+    if (slab == (int) slabs.size())
+        slabs.push_back((char *) ::operator new(SLOTS_PER_SLAB * SLOT_SIZE));
+    return slabs[slab] + SLOT_SIZE * used++;
+}
+
+/**
+ * Give back a slot whose object has already been destroyed
+ */
+void CellPool::release(void * slot){
+    *(void **) slot = free_list;
+    free_list = slot;
+}
+
+/**
+ * Make every slot available again, the objects they hold must not be used anymore
+ *
+ * The objects are not destroyed, which is fine for Cells and CellNodes since they own no resources.
+ */
+void CellPool::clear(){
+    slab = 0;
+    used = 0;
+    free_list = nullptr;
+}
+
+/**
+ * Destroy a cell made with make_cell and give back its slot
+ */
+void CellPool::destroy(Cell * cell){
+    cell -> ~Cell();
+    release(cell);
+}
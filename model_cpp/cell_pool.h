@@ -0,0 +1,41 @@
+#ifndef RADIO_RL_CELL_POOL_H
+#define RADIO_RL_CELL_POOL_H
+
+#include <new>
+#include <vector>
+#include "cell.h"
+
+/**
+ * Slab allocator for the Cells and CellNodes of the CellLists of a model
+ *
+ * Every object gets a slot of the same size, carved out of slabs of SLOTS_PER_SLAB slots. Released slots are reused
+ * through a free list, and clear() makes every slot available again at once, without visiting the objects, so that a
+ * whole population can be dropped when the model is reset. The memory of the slabs is only given back by the
+ * destructor.
+ */
+class CellPool {
+public:
+    CellPool();
+    CellPool(const CellPool &) = delete;
+    ~CellPool();
+    void * allocate();
+    void release(void * slot);
+    void clear();
+    void destroy(Cell * cell);
+    template <typename T> T * make_cell(char stage, SimContext * ctx);
+private:
+    std::vector<char *> slabs;
+    int slab; // Slab from which new slots are taken once the free list is empty
+    int used; // Number of slots taken from that slab
+    void * free_list; // Each free slot starts with a pointer to the next one
+};
+
+/**
+ * Construct a cell of type T (HealthyCell, CancerCell or OARCell) in a slot of the pool
+ */
+template <typename T>
+T * CellPool::make_cell(char stage, SimContext * ctx){
+    return new (allocate()) T(stage, ctx);
+}
+
+#endif //RADIO_RL_CELL_POOL_H
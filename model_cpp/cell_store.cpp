@@ -0,0 +1,314 @@
+#include "cell_store.h"
+#include <algorithm>
+
+
+/**
+ * Return the number of cells in the columns
+ */
+int CellColumns::count(){
+    return (int) type.size();
+}
+
+/**
+ * Remove all the cells from the columns, keeping their capacity
+ */
+void CellColumns::clear(){
+    type.clear();
+    stage.clear();
+    age.clear();
+    repair.clear();
+    glu_efficiency.clear();
+    oxy_efficiency.clear();
+    pixel.clear();
+}
+
+/**
+ * Exchange the content of these columns with the content of other
+ */
+void CellColumns::swap(CellColumns & other){
+    type.swap(other.type);
+    stage.swap(other.stage);
+    age.swap(other.age);
+    repair.swap(other.repair);
+    glu_efficiency.swap(other.glu_efficiency);
+    oxy_efficiency.swap(other.oxy_efficiency);
+    pixel.swap(other.pixel);
+}
+
+/**
+ * Append a copy of the cell at index k of from
+ */
+void CellColumns::push_back(CellColumns & from, int k){
+    type.push_back(from.type[k]);
+    stage.push_back(from.stage[k]);
+    age.push_back(from.age[k]);
+    repair.push_back(from.repair[k]);
+    glu_efficiency.push_back(from.glu_efficiency[k]);
+    oxy_efficiency.push_back(from.oxy_efficiency[k]);
+    pixel.push_back(from.pixel[k]);
+}
+
+/**
+ * Append a new cell, with no age and no repair time
+ */
+void CellColumns::push_back(char type, char stage, double glu_efficiency, double oxy_efficiency, int pixel){
+    this -> type.push_back(type);
+    this -> stage.push_back(stage);
+    age.push_back(0);
+    repair.push_back(0);
+    this -> glu_efficiency.push_back(glu_efficiency);
+    this -> oxy_efficiency.push_back(oxy_efficiency);
+    this -> pixel.push_back(pixel);
+}
+
+/**
+ * Constructor of CellStore
+ *
+ * @param xsize The number of rows of the grid
+ * @param ysize The number of columns of the grid
+ */
+CellStore::CellStore(int xsize, int ysize): size(xsize * ysize, 0), ccell_count(xsize * ysize, 0),
+                                            oar_count(xsize * ysize, 0), cancer_box{0, 0, 0, 0}, cancer_total(0),
+                                            cancer_sum_x(0), cancer_sum_y(0), version(0), stats(nullptr), pixels(xsize * ysize),
+                                            ysize(ysize), has_dead(false), offsets(xsize * ysize + 1, 0),
+                                            new_offsets(xsize * ysize + 1, 0), pending_offsets(xsize * ysize + 1, 0) {}
+
+/**
+ * Create a new cell on a pixel
+ *
+ * The cell only becomes part of the pixel's cells at the next commit(), but is counted in the simulation's context
+ * right away (and draws its efficiencies), like the constructors of the Cell classes do.
+ *
+ * @param pixel The pixel of the new cell
+ * @param type The type of the new cell
+ * @param stage The stage of the new cell in the cell cycle
+ * @param ctx The context of the simulation
+ */
+void CellStore::add(int pixel, char type, char stage, SimContext * ctx){
+    create(pending, pixel, type, stage, ctx);
+}
+
+/**
+ * Create a new cell in a separate set of columns, to be given to a CellStore later with add_all (see add)
+ *
+ * @param to The columns the cell is appended to
+ * @param pixel The pixel of the new cell
+ * @param type The type of the new cell
+ * @param stage The stage of the new cell in the cell cycle
+ * @param ctx The context counting the cell and drawing its efficiencies
+ */
+void CellStore::create(CellColumns & to, int pixel, char type, char stage, SimContext * ctx){
+    double glu_efficiency = 0.0;
+    double oxy_efficiency = 0.0;
+    if (type == 'h'){
+        ctx -> hcell_count++;
+        Cell::draw_efficiency(glu_efficiency, oxy_efficiency, ctx);
+    } else if (type == 'o'){
+        ctx -> oar_count++;
+        Cell::draw_efficiency(glu_efficiency, oxy_efficiency, ctx);
+    } else {
+        ctx -> ccell_count++;
+    }
+    to.push_back(type, stage, glu_efficiency, oxy_efficiency, pixel);
+}
+
+/**
+ * Add cells made with create, in order, as if they had been created with add
+ *
+ * @param created The new cells, which are left in place
+ */
+void CellStore::add_all(CellColumns & created){
+    for (int k = 0; k < created.count(); k++)
+        pending.push_back(created, k);
+}
+
+/**
+ * Remove dead cells and insert the cells created since the last commit
+ *
+ * On each pixel, new cancer cells go in front of the existing cells and new healthy and OAR cells after them, both in
+ * order of creation.
+ */
+void CellStore::commit(){
+    int num_pending = pending.count();
+    if (num_pending == 0 && !has_dead)
+        return;
+    // Stable counting sort of the pending cells by pixel
+    std::fill(pending_offsets.begin(), pending_offsets.end(), 0);
+    for (int k = 0; k < num_pending; k++)
+        pending_offsets[pending.pixel[k] + 1]++;
+    for (int p = 0; p < pixels; p++)
+        pending_offsets[p + 1] += pending_offsets[p];
+    pending_order.resize(num_pending);
+    for (int k = 0; k < num_pending; k++)
+        pending_order[pending_offsets[pending.pixel[k]]++] = k;
+    for (int p = pixels; p > 0; p--) // Shift back the offsets that the sort moved forward
+        pending_offsets[p] = pending_offsets[p - 1];
+    pending_offsets[0] = 0;
+
+    scratch.clear();
+    size_t capacity = scratch.type.capacity();
+    new_offsets[0] = 0;
+    cancer_box = PixelBox{0, 0, 0, 0};
+    cancer_total = 0;
+    cancer_sum_x = 0;
+    cancer_sum_y = 0;
+    version++;
+    for (int p = 0; p < pixels; p++){
+        int ccells = 0;
+        int oars = 0;
+        for (int n = pending_offsets[p]; n < pending_offsets[p + 1]; n++){
+            int k = pending_order[n];
+            if (pending.type[k] == 'c'){
+                scratch.push_back(pending, k);
+                ccells++;
+            }
+        }
+        for (int k = offsets[p]; k < offsets[p + 1]; k++){
+            if (stage[k] != 'd'){
+                scratch.push_back(*this, k);
+                ccells += (type[k] == 'c');
+                oars += (type[k] == 'o');
+            }
+        }
+        for (int n = pending_offsets[p]; n < pending_offsets[p + 1]; n++){
+            int k = pending_order[n];
+            if (pending.type[k] != 'c'){
+                scratch.push_back(pending, k);
+                oars += (pending.type[k] == 'o');
+            }
+        }
+        new_offsets[p + 1] = scratch.count();
+        size[p] = new_offsets[p + 1] - new_offsets[p];
+        ccell_count[p] = ccells;
+        oar_count[p] = oars;
+        if (ccells > 0)
+            add_cancer_cells(p, ccells);
+    }
+    if (stats){
+        SIM_STAT(stats -> compactions++);
+        SIM_STAT(stats -> allocations += (scratch.type.capacity() != capacity));
+    }
+    swap(scratch);
+    offsets.swap(new_offsets);
+    pending.clear();
+    has_dead = false;
+}
+
+/**
+ * Rebuild the per-pixel offsets and counts after the columns have been filled directly
+ *
+ * The cells must be sorted by pixel, alive, and there must be no cell waiting for commit().
+ */
+void CellStore::reindex(){
+    std::fill(offsets.begin(), offsets.end(), 0);
+    std::fill(ccell_count.begin(), ccell_count.end(), 0);
+    std::fill(oar_count.begin(), oar_count.end(), 0);
+    for (int k = 0; k < count(); k++){
+        offsets[pixel[k] + 1]++;
+        ccell_count[pixel[k]] += (type[k] == 'c');
+        oar_count[pixel[k]] += (type[k] == 'o');
+    }
+    for (int p = 0; p < pixels; p++){
+        size[p] = offsets[p + 1];
+        offsets[p + 1] += offsets[p];
+    }
+    has_dead = false;
+    cancer_box = PixelBox{0, 0, 0, 0};
+    cancer_total = 0;
+    cancer_sum_x = 0;
+    cancer_sum_y = 0;
+    version++;
+    for (int p = 0; p < pixels; p++){
+        if (ccell_count[p] > 0)
+            add_cancer_cells(p, ccell_count[p]);
+    }
+}
+
+/**
+ * Account for the cancer cells of a pixel in cancer_box and in the sums of coordinates, pixels being given in
+ * increasing order since they were reset
+ */
+void CellStore::add_cancer_cells(int pixel, int count){
+    int x = pixel / ysize;
+    int y = pixel % ysize;
+    cancer_total += count;
+    cancer_sum_x += (long long) count * x;
+    cancer_sum_y += (long long) count * y;
+    if (cancer_box.x1 >= cancer_box.x2){
+        cancer_box = PixelBox{x, x + 1, y, y + 1};
+        return;
+    }
+    cancer_box.x2 = x + 1; // Pixels come row by row, so only the columns can go back
+    cancer_box.y1 = std::min(cancer_box.y1, y);
+    cancer_box.y2 = std::max(cancer_box.y2, y + 1);
+}
+
+/**
+ * Recompute the counts of living cells of a pixel after some of them may have died
+ *
+ * @param pixel The pixel whose counts are updated
+ */
+void CellStore::update_counts(int pixel){
+    if (recount(pixel))
+        has_dead = true;
+}
+
+/**
+ * Recompute the counts of living cells of a pixel, touching nothing but the pixel's own counts
+ *
+ * Used when several pixels are updated in parallel: if some cells are found dead, mark_dead must be called before the
+ * next commit() so that they get removed.
+ *
+ * @param pixel The pixel whose counts are updated
+ * @return Whether some cells of the pixel are dead
+ */
+bool CellStore::recount(int pixel){
+    int alive = 0;
+    int ccells = 0;
+    int oars = 0;
+    for (int k = offsets[pixel]; k < offsets[pixel + 1]; k++){
+        bool is_alive = (stage[k] != 'd');
+        alive += is_alive;
+        ccells += is_alive && type[k] == 'c';
+        oars += is_alive && type[k] == 'o';
+    }
+    size[pixel] = alive;
+    ccell_count[pixel] = ccells;
+    oar_count[pixel] = oars;
+    return alive < offsets[pixel + 1] - offsets[pixel];
+}
+
+/**
+ * Record that some cells have died since the last commit() (see recount)
+ */
+void CellStore::mark_dead(){
+    has_dead = true;
+}
+
+/**
+ * Sets all the OARCells present on a pixel out of quiescence
+ *
+ * @param pixel The pixel whose OARCells are woken
+ */
+void CellStore::wake_oar(int pixel){
+    if (oar_count[pixel] == 0)
+        return;
+    for (int k = offsets[pixel]; k < offsets[pixel + 1]; k++){
+        if (type[k] == 'o')
+            Cell::wake(stage[k], age[k]);
+    }
+}
+
+/**
+ * Return the index of the first cell of a pixel
+ */
+int CellStore::begin(int pixel){
+    return offsets[pixel];
+}
+
+/**
+ * Return the index following the last cell of a pixel
+ */
+int CellStore::end(int pixel){
+    return offsets[pixel + 1];
+}
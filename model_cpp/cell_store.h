@@ -0,0 +1,76 @@
+#ifndef RADIO_RL_CELL_STORE_H
+#define RADIO_RL_CELL_STORE_H
+
+#include <vector>
+#include "cell.h"
+#include "sim_context.h"
+
+/**
+ * Parallel arrays holding the state of a set of cells, cell k being described by the k-th entry of each array
+ */
+struct CellColumns {
+    std::vector<char> type; // 'h' for healthy, 'c' for cancer, 'o' for OAR
+    std::vector<char> stage; // 'd' once the cell is dead
+    std::vector<short> age;
+    std::vector<short> repair;
+    std::vector<double> glu_efficiency; // Unused for cancer cells, which draw their efficiency every hour
+    std::vector<double> oxy_efficiency;
+    std::vector<int> pixel; // x * ysize + y
+    int count();
+    void clear();
+    void swap(CellColumns & other);
+    void push_back(CellColumns & from, int k);
+    void push_back(char type, char stage, double glu_efficiency, double oxy_efficiency, int pixel);
+};
+
+/**
+ * Rectangle of pixels [x1, x2) x [y1, y2), empty if x1 >= x2 or y1 >= y2
+ */
+struct PixelBox {
+    int x1, x2, y1, y2;
+};
+
+/**
+ * Contiguous structure-of-arrays storage of all the cells of a Grid
+ *
+ * Cells are sorted by pixel: the cells of a pixel are at indices [begin(pixel), end(pixel)), with the cancer cells
+ * first, in the same order as the CellLists used to keep them. Cells created with add() are kept aside and dead cells
+ * stay in place (with stage 'd') until commit() is called, which rebuilds the storage in one linear pass.
+ */
+class CellStore : public CellColumns {
+public:
+    CellStore(int xsize, int ysize);
+    static void create(CellColumns & to, int pixel, char type, char stage, SimContext * ctx);
+    void add(int pixel, char type, char stage, SimContext * ctx);
+    void add_all(CellColumns & created);
+    void commit();
+    void reindex();
+    void update_counts(int pixel);
+    bool recount(int pixel);
+    void mark_dead();
+    void wake_oar(int pixel);
+    int begin(int pixel);
+    int end(int pixel);
+    std::vector<int> size; // Number of living cells on each pixel, not counting the ones waiting for commit()
+    std::vector<int> ccell_count;
+    std::vector<int> oar_count;
+    PixelBox cancer_box; // Smallest box holding all the cancer cells as of the last commit(), which cells can only leave
+    long long cancer_total; // Number of cancer cells and sums of their coordinates, as of the last commit()
+    long long cancer_sum_x;
+    long long cancer_sum_y;
+    int version; // Changes every time commit() or reindex() modifies the cells
+    SimStats * stats; // Where commit() counts compactions and allocations, nullptr if they are not counted
+private:
+    void add_cancer_cells(int pixel, int count);
+    int pixels;
+    int ysize;
+    bool has_dead;
+    std::vector<int> offsets;
+    std::vector<int> new_offsets;
+    std::vector<int> pending_offsets;
+    std::vector<int> pending_order;
+    CellColumns pending;
+    CellColumns scratch;
+};
+
+#endif //RADIO_RL_CELL_STORE_H
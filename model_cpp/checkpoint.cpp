@@ -0,0 +1,380 @@
+#include "checkpoint.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(CheckpointHeader) % 8 == 0, "The sections of a checkpoint must stay aligned on 8 bytes");
+static_assert(sizeof(CheckpointLibraryHeader) % 8 == 0, "The offsets of a library must stay aligned on 8 bytes");
+static_assert(sizeof(int) == 4 && sizeof(short) == 2, "Checkpoints store ints on 32 bits and shorts on 16 bits");
+
+static const char checkpoint_magic[8] = {'R', 'A', 'D', 'I', 'O', 'C', 'K', 'P'};
+static const char library_magic[8] = {'R', 'A', 'D', 'I', 'O', 'L', 'I', 'B'};
+
+static size_t align8(size_t n){
+    return (n + 7) & ~(size_t) 7;
+}
+
+/**
+ * Offsets of the sections of a checkpoint from its start, as described in checkpoint.h
+ */
+struct CheckpointLayout {
+    size_t glucose, oxygen, glu_efficiency, oxy_efficiency, neigh_counts, pixel, sources, age, repair, type, stage;
+    size_t rng_state;
+    size_t total;
+    CheckpointLayout(const CheckpointHeader & header);
+};
+
+CheckpointLayout::CheckpointLayout(const CheckpointHeader & header){
+    size_t pixels = (size_t) header.xsize * header.ysize;
+    size_t cells = header.num_cells;
+    glucose = sizeof(CheckpointHeader);
+    oxygen = align8(glucose + pixels * sizeof(double));
+    glu_efficiency = align8(oxygen + pixels * sizeof(double));
+    oxy_efficiency = align8(glu_efficiency + cells * sizeof(double));
+    neigh_counts = align8(oxy_efficiency + cells * sizeof(double));
+    pixel = align8(neigh_counts + pixels * sizeof(int32_t));
+    sources = align8(pixel + cells * sizeof(int32_t));
+    age = align8(sources + 2 * (size_t) header.num_sources * sizeof(int32_t));
+    repair = align8(age + cells * sizeof(int16_t));
+    type = align8(repair + cells * sizeof(int16_t));
+    stage = align8(type + cells);
+    rng_state = align8(stage + cells);
+    total = align8(rng_state + header.rng_state_size);
+}
+
+/**
+ * Fill the header describing the current state of a controller
+ */
+void Checkpoint::fill_header(Controller * controller, const std::string & rng_state, CheckpointHeader & header){
+    Grid * grid = controller -> grid;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.xsize = controller -> xsize;
+    header.ysize = controller -> ysize;
+    header.tick = controller -> tick;
+    header.num_cells = grid -> cells.count();
+    header.num_sources = grid -> sources -> size;
+    header.rng_state_size = (int32_t) rng_state.size();
+    header.hcell_count = controller -> hcell_count();
+    header.ccell_count = controller -> ccell_count();
+    header.oar_count = controller -> oar_count();
+    if (grid -> oar){
+        header.has_oar = 1;
+        header.oar_x1 = grid -> oar -> x1;
+        header.oar_x2 = grid -> oar -> x2;
+        header.oar_y1 = grid -> oar -> y1;
+        header.oar_y2 = grid -> oar -> y2;
+    }
+    header.center_x = grid -> center_x;
+    header.center_y = grid -> center_y;
+    header.total_size = CheckpointLayout(header).total;
+}
+
+/**
+ * Return the number of bytes needed to write the checkpoint of a controller
+ */
+size_t Checkpoint::size(Controller * controller){
+    Grid * grid = controller -> grid;
+    grid -> cells.commit();
+    CheckpointHeader header;
+    fill_header(controller, grid -> ctx.get_state(), header);
+    return header.total_size;
+}
+
+/**
+ * Write the checkpoint of a controller
+ *
+ * @param controller The controller to save
+ * @param out Buffer of at least Checkpoint::size(controller) bytes
+ */
+void Checkpoint::write(Controller * controller, char * out){
+    Grid * grid = controller -> grid;
+    grid -> cells.commit();
+    std::string rng_state = grid -> ctx.get_state();
+    CheckpointHeader header;
+    fill_header(controller, rng_state, header);
+    CheckpointLayout layout(header);
+    CellStore & cells = grid -> cells;
+    size_t num_cells = header.num_cells;
+    memset(out, 0, layout.total); // Padding is written as zeros so that identical states give identical files
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + layout.glu_efficiency, cells.glu_efficiency.data(), num_cells * sizeof(double));
+    memcpy(out + layout.oxy_efficiency, cells.oxy_efficiency.data(), num_cells * sizeof(double));
+    for (int i = 0; i < header.xsize; i++){ // The fields are written without their halo and padding
+        memcpy(out + layout.glucose + i * header.ysize * sizeof(double), grid -> glucose[i],
+               header.ysize * sizeof(double));
+        memcpy(out + layout.oxygen + i * header.ysize * sizeof(double), grid -> oxygen[i],
+               header.ysize * sizeof(double));
+        memcpy(out + layout.neigh_counts + i * header.ysize * sizeof(int32_t), grid -> neigh_counts[i],
+               header.ysize * sizeof(int32_t));
+    }
+    memcpy(out + layout.pixel, cells.pixel.data(), num_cells * sizeof(int32_t));
+    int32_t * sources = (int32_t *) (out + layout.sources);
+    for (Source * current = grid -> sources -> head; current; current = current -> next){
+        *sources++ = current -> x;
+        *sources++ = current -> y;
+    }
+    memcpy(out + layout.age, cells.age.data(), num_cells * sizeof(int16_t));
+    memcpy(out + layout.repair, cells.repair.data(), num_cells * sizeof(int16_t));
+    memcpy(out + layout.type, cells.type.data(), num_cells);
+    memcpy(out + layout.stage, cells.stage.data(), num_cells);
+    memcpy(out + layout.rng_state, rng_state.data(), rng_state.size());
+}
+
+/**
+ * Copy a section of a checkpoint into a column of cells
+ */
+template <typename T>
+static void read_column(std::vector<T> & column, const char * section, size_t count){
+    column.resize(count);
+    memcpy(column.data(), section, count * sizeof(T));
+}
+
+/**
+ * Create a new controller from a checkpoint
+ *
+ * The controller has its own copy of the state, data can be released once this returns. data must be aligned on 8
+ * bytes, which is the case for files mapped in memory and for the checkpoints of a library. The cells must have a valid
+ * pixel, type and stage, and as many of each type as the population counters of the header say.
+ *
+ * @param data The checkpoint
+ * @param size The number of bytes available at data
+ * @return The new controller, or nullptr if data is not a valid checkpoint of this version
+ */
+Controller * Checkpoint::read(const char * data, size_t size){
+    CheckpointHeader header;
+    if (size < sizeof(header))
+        return nullptr;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0 || header.version != CHECKPOINT_VERSION)
+        return nullptr;
+    if (header.xsize <= 0 || header.ysize <= 0 || header.num_cells < 0 || header.num_sources < 0 ||
+        header.rng_state_size < 0)
+        return nullptr;
+    CheckpointLayout layout(header);
+    if (layout.total != header.total_size || layout.total > size)
+        return nullptr;
+
+    int pixels = header.xsize * header.ysize;
+    size_t num_cells = header.num_cells;
+    const int32_t * pixel = (const int32_t *) (data + layout.pixel);
+    const int32_t * sources = (const int32_t *) (data + layout.sources);
+    const char * type = data + layout.type;
+    const char * stage = data + layout.stage;
+    static const char cell_types[] = "hco";
+    int counts[3] = {0, 0, 0}; // Cells of each of cell_types, which must match the counters of the header
+    for (size_t k = 0; k < num_cells; k++){ // The cells must be sorted by pixel for the CellStore
+        if (pixel[k] < 0 || pixel[k] >= pixels || (k > 0 && pixel[k] < pixel[k - 1]))
+            return nullptr;
+        const char * kind = type[k] ? strchr(cell_types, type[k]) : nullptr;
+        if (!kind || !stage[k] || !strchr("1s2mq", stage[k]))
+            return nullptr;
+        counts[kind - cell_types]++;
+    }
+    if (counts[0] != header.hcell_count || counts[1] != header.ccell_count || counts[2] != header.oar_count)
+        return nullptr;
+    for (int k = 0; k < header.num_sources; k++){
+        if (sources[2 * k] < 0 || sources[2 * k] >= header.xsize || sources[2 * k + 1] < 0 ||
+            sources[2 * k + 1] >= header.ysize)
+            return nullptr;
+    }
+
+    OARZone * oar = nullptr;
+    if (header.has_oar){
+        oar = new OARZone;
+        oar -> x1 = header.oar_x1;
+        oar -> x2 = header.oar_x2;
+        oar -> y1 = header.oar_y1;
+        oar -> y2 = header.oar_y2;
+    }
+    Grid * grid = new Grid(header.xsize, header.ysize, 0, oar, 0);
+    if (!grid -> ctx.set_state(std::string(data + layout.rng_state, header.rng_state_size))){
+        delete grid;
+        delete oar;
+        return nullptr;
+    }
+    for (int i = 0; i < header.xsize; i++){
+        memcpy(grid -> glucose[i], data + layout.glucose + i * header.ysize * sizeof(double),
+               header.ysize * sizeof(double));
+        memcpy(grid -> oxygen[i], data + layout.oxygen + i * header.ysize * sizeof(double),
+               header.ysize * sizeof(double));
+        memcpy(grid -> neigh_counts[i], data + layout.neigh_counts + i * header.ysize * sizeof(int32_t),
+               header.ysize * sizeof(int32_t));
+    }
+    CellStore & cells = grid -> cells;
+    read_column(cells.glu_efficiency, data + layout.glu_efficiency, num_cells);
+    read_column(cells.oxy_efficiency, data + layout.oxy_efficiency, num_cells);
+    read_column(cells.pixel, data + layout.pixel, num_cells);
+    read_column(cells.age, data + layout.age, num_cells);
+    read_column(cells.repair, data + layout.repair, num_cells);
+    read_column(cells.type, data + layout.type, num_cells);
+    read_column(cells.stage, data + layout.stage, num_cells);
+    cells.reindex();
+    for (int k = 0; k < header.num_sources; k++)
+        grid -> sources -> add(sources[2 * k], sources[2 * k + 1]);
+    grid -> ctx.hcell_count = header.hcell_count;
+    grid -> ctx.ccell_count = header.ccell_count;
+    grid -> ctx.oar_count = header.oar_count;
+    grid -> center_x = header.center_x;
+    grid -> center_y = header.center_y;
+    return new Controller(grid, oar, header.xsize, header.ysize, header.tick);
+}
+
+/**
+ * Write a buffer to a file
+ */
+static bool write_file(const char * path, const std::vector<char> & buffer){
+    FILE * file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    return (fclose(file) == 0) && written;
+}
+
+/**
+ * Map a whole file read-only in memory
+ *
+ * @param path The path of the file
+ * @param length Set to the size of the file
+ * @return The start of the mapping, or nullptr if the file could not be mapped
+ */
+static const char * map_file(const char * path, size_t & length){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0){
+        close(fd);
+        return nullptr;
+    }
+    length = info.st_size;
+    void * mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping stays valid after the file is closed
+    return (mapping == MAP_FAILED) ? nullptr : (const char *) mapping;
+}
+
+/**
+ * Save the checkpoint of a controller to a file
+ *
+ * @return true if the file was written
+ */
+bool Checkpoint::save(Controller * controller, const char * path){
+    std::vector<char> buffer(size(controller));
+    write(controller, buffer.data());
+    return write_file(path, buffer);
+}
+
+/**
+ * Load a controller from a checkpoint file written by Checkpoint::save
+ *
+ * @return The new controller, or nullptr if the file could not be read or is not a valid checkpoint
+ */
+Controller * Checkpoint::load(const char * path){
+    size_t length;
+    const char * data = map_file(path, length);
+    if (!data)
+        return nullptr;
+    Controller * controller = read(data, length);
+    munmap((void *) data, length);
+    return controller;
+}
+
+/**
+ * Save the checkpoints of several controllers in a single library file, to be opened with CheckpointLibrary
+ *
+ * @param controllers The controllers to save
+ * @param count The number of controllers
+ * @param path The path of the library file
+ * @return true if the file was written
+ */
+bool Checkpoint::save_library(Controller ** controllers, int count, const char * path){
+    CheckpointLibraryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, library_magic, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.num_checkpoints = count;
+    std::vector<uint64_t> offsets(count);
+    size_t total = align8(sizeof(header) + count * sizeof(uint64_t));
+    for (int i = 0; i < count; i++){
+        offsets[i] = total;
+        total += size(controllers[i]); // Checkpoint sizes are multiples of 8
+    }
+    std::vector<char> buffer(total, 0);
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + sizeof(header), offsets.data(), count * sizeof(uint64_t));
+    for (int i = 0; i < count; i++)
+        write(controllers[i], buffer.data() + offsets[i]);
+    return write_file(path, buffer);
+}
+
+/**
+ * Constructor of CheckpointLibrary, maps a library file written by Checkpoint::save_library
+ *
+ * The mapping is read-only and shared, so that every process using the same library shares the same physical memory.
+ * is_open() returns false if the file could not be mapped or is not a valid library.
+ *
+ * @param path The path of the library file
+ */
+CheckpointLibrary::CheckpointLibrary(const char * path): length(0), num_checkpoints(0), offsets(nullptr){
+    data = map_file(path, length);
+    if (!data)
+        return;
+    CheckpointLibraryHeader header;
+    bool valid = length >= sizeof(header);
+    if (valid){
+        memcpy(&header, data, sizeof(header));
+        valid = memcmp(header.magic, library_magic, sizeof(header.magic)) == 0 && header.version == CHECKPOINT_VERSION &&
+                sizeof(header) + (size_t) header.num_checkpoints * sizeof(uint64_t) <= length;
+    }
+    if (valid){
+        offsets = (const uint64_t *) (data + sizeof(header));
+        for (uint32_t i = 0; i < header.num_checkpoints && valid; i++)
+            valid = offsets[i] % 8 == 0 && offsets[i] < length;
+    }
+    if (!valid){
+        munmap((void *) data, length);
+        data = nullptr;
+        offsets = nullptr;
+        return;
+    }
+    num_checkpoints = header.num_checkpoints;
+}
+
+/**
+ * Destructor of CheckpointLibrary, unmaps the file
+ */
+CheckpointLibrary::~CheckpointLibrary(){
+    if (data)
+        munmap((void *) data, length);
+}
+
+/**
+ * Return true if the library file was mapped successfully
+ */
+bool CheckpointLibrary::is_open(){
+    return data != nullptr;
+}
+
+/**
+ * Return the number of checkpoints in the library
+ */
+int CheckpointLibrary::size(){
+    return num_checkpoints;
+}
+
+/**
+ * Create a new controller from the checkpoint at index in the library
+ *
+ * @return The new controller, or nullptr if the index is out of range or the checkpoint is invalid
+ */
+Controller * CheckpointLibrary::instantiate(int index){
+    if (index < 0 || index >= num_checkpoints)
+        return nullptr;
+    return Checkpoint::read(data + offsets[index], length - offsets[index]);
+}
@@ -0,0 +1,78 @@
+#ifndef RADIO_RL_CHECKPOINT_H
+#define RADIO_RL_CHECKPOINT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "controller.h"
+
+#define CHECKPOINT_VERSION 2
+
+/**
+ * Header of a checkpoint, followed by its sections in this order (each aligned on 8 bytes):
+ * glucose and oxygen (xsize * ysize doubles each), glucose and oxygen efficiencies of the cells (num_cells doubles
+ * each), neighbour counts (xsize * ysize int32), pixels of the cells (num_cells int32), sources (num_sources pairs of
+ * int32), ages and repair times of the cells (num_cells int16 each), types and stages of the cells (num_cells chars each)
+ * and the state of the random streams (rng_state_size chars). Cells are sorted by pixel, as in the CellStore.
+ */
+struct CheckpointHeader {
+    char magic[8]; // "RADIOCKP"
+    uint32_t version;
+    uint32_t has_oar;
+    uint64_t total_size; // Size of the checkpoint in bytes, header included
+    int32_t xsize, ysize;
+    int32_t tick;
+    int32_t num_cells;
+    int32_t num_sources;
+    int32_t rng_state_size;
+    int32_t hcell_count, ccell_count, oar_count;
+    int32_t oar_x1, oar_x2, oar_y1, oar_y2;
+    int32_t reserved;
+    double center_x, center_y;
+};
+
+/**
+ * Header of a library of checkpoints, followed by num_checkpoints uint64 offsets (from the start of the file) of the
+ * checkpoints
+ */
+struct CheckpointLibraryHeader {
+    char magic[8]; // "RADIOLIB"
+    uint32_t version;
+    uint32_t num_checkpoints;
+};
+
+/**
+ * Saving and loading of the full state of a Controller (grid, cells, nutrient sources, OAR zone, tick and random streams)
+ */
+class Checkpoint {
+public:
+    static size_t size(Controller * controller);
+    static void write(Controller * controller, char * out);
+    static Controller * read(const char * data, size_t size);
+    static bool save(Controller * controller, const char * path);
+    static Controller * load(const char * path);
+    static bool save_library(Controller ** controllers, int count, const char * path);
+private:
+    static void fill_header(Controller * controller, const std::string & rng_state, CheckpointHeader & header);
+};
+
+/**
+ * Read-only library of checkpoints mapped in memory, which can be shared by several processes
+ *
+ * Controllers instantiated from the library have their own copy of the state and do not depend on the library.
+ */
+class CheckpointLibrary {
+public:
+    CheckpointLibrary(const char * path);
+    ~CheckpointLibrary();
+    bool is_open();
+    int size();
+    Controller * instantiate(int index);
+private:
+    const char * data;
+    size_t length;
+    int num_checkpoints;
+    const uint64_t * offsets;
+};
+
+#endif //RADIO_RL_CHECKPOINT_H
@@ -0,0 +1,373 @@
+#include "cohort_population.h"
+#include "cell_kernels.h"
+
+using namespace std;
+
+/*
+ * Dimensions of the cohorts: the type (0 for healthy cells, 1 for cancer cells), the stage, the remaining hours of
+ * repair and the age. Cells never stay in a stage longer than gap1_hours, and the age of quiescent cells, which is
+ * never read, is always kept at 0.
+ */
+constexpr int cohort_types = 2;
+constexpr char cohort_stages[] = {'1', 's', '2', 'm', 'q'};
+constexpr int cohort_stage_count = 5;
+constexpr int cohort_ages = gap1_hours + 1;
+constexpr int max_repair_increase = 2 * repair_time; // See HealthyCell::radiate_kernel
+constexpr double efficiency_variance = 0.3333333 * 0.3333333; // Variance of the efficiency of a cell, see SimContext::norm
+
+/**
+ * Index of a stage in cohort_stages
+ */
+static int stage_index(char stage){
+    switch (stage){
+        case '1':
+            return 0;
+        case 's':
+            return 1;
+        case '2':
+            return 2;
+        case 'm':
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+/**
+ * Constructor of an empty CohortPopulation
+ */
+CohortPopulation::CohortPopulation(): repair_levels(0) {
+    reserve_repair(max_repair_increase + 1);
+}
+
+/**
+ * Remove all the cells
+ */
+void CohortPopulation::clear(){
+    fill(counts.begin(), counts.end(), 0);
+}
+
+/**
+ * Index of a cohort in counts
+ */
+inline int CohortPopulation::index(int type, int stage, int repair, int age){
+    return ((type * cohort_stage_count + stage) * repair_levels + repair) * cohort_ages + age;
+}
+
+/**
+ * Make sure the cohorts can hold cells with up to levels - 1 hours of repair
+ */
+void CohortPopulation::reserve_repair(int levels){
+    if (levels <= repair_levels)
+        return;
+    vector<int> grown(cohort_types * cohort_stage_count * levels * cohort_ages, 0);
+    for (int type = 0; type < cohort_types; type++){
+        for (int stage = 0; stage < cohort_stage_count; stage++){
+            for (int repair = 0; repair < repair_levels; repair++){
+                for (int age = 0; age < cohort_ages; age++)
+                    grown[((type * cohort_stage_count + stage) * levels + repair) * cohort_ages + age] =
+                            counts[index(type, stage, repair, age)];
+            }
+        }
+    }
+    counts.swap(grown);
+    next_counts.assign(counts.size(), 0);
+    repair_levels = levels;
+}
+
+/**
+ * Add new cells, of age 0 and without any repair
+ *
+ * @param type 'h' for healthy cells, 'c' for cancer cells
+ * @param stage Stage of the cells
+ * @param count Number of cells
+ * @param ctx The context of the simulation, whose population counters are updated
+ */
+void CohortPopulation::add(char type, char stage, int count, SimContext * ctx){
+    counts[index(type == 'c' ? 1 : 0, stage_index(stage), 0, 0)] += count;
+    if (type == 'c')
+        ctx -> ccell_count += count;
+    else
+        ctx -> hcell_count += count;
+}
+
+/**
+ * Number of cells, among total cells consuming from a pool in turn, that find the pool at or above level
+ *
+ * The consumption of the first j cells is taken as j * mean + sqrt(j) * deviation * noise, which is the normal
+ * approximation of a sum of independent consumptions with this mean and standard deviation.
+ *
+ * @param noise Draw from the standard normal distribution, shared by all the levels of an hour
+ */
+int CohortPopulation::reach(double pool, double mean, double deviation, double noise, double level, int total){
+    if (pool < level)
+        return 0;
+    if (mean <= 0.0)
+        return total;
+    // Solve mean * x^2 + deviation * noise * x = pool - level for x = sqrt(j)
+    double b = deviation * noise;
+    double x = (sqrt(b * b + 4.0 * mean * (pool - level)) - b) / (2.0 * mean);
+    double fed = floor(x * x) + 1.0;
+    return fed >= (double) total ? total : (int) fed;
+}
+
+/**
+ * Advance the cells of a cohort by one hour, with the kernels of the per-cell model, and add them to next_counts
+ *
+ * @param glucose Glucose seen by the cells, which must not make them die
+ * @param oxygen Oxygen seen by the cells, which must not make them die
+ */
+void CohortPopulation::advance(int type, int stage, int repair, int age, int count, double glucose, double oxygen,
+                               int neigh_count, SimContext * ctx){
+    if (count == 0)
+        return;
+    char new_stage = cohort_stages[stage];
+    short new_age = (short) age;
+    short new_repair = (short) repair;
+    cell_cycle_res result;
+    if (type == 0)
+        result = HealthyCell::cycle_kernel(new_stage, new_age, new_repair, average_glucose_absorption,
+                                           average_oxygen_consumption, glucose, oxygen, neigh_count, ctx);
+    else
+        result = CancerCell::cycle_kernel(new_stage, new_age, new_repair, 1.0, glucose, oxygen, neigh_count, ctx);
+    if (new_stage == 'q')
+        new_age = 0;
+    next_counts[index(type, stage_index(new_stage), new_repair, min((int) new_age, cohort_ages - 1))] += count;
+    if (result.new_cell == 'h'){
+        next_counts[index(0, stage_index('1'), 0, 0)] += count;
+        ctx -> hcell_count += count;
+    } else if (result.new_cell == 'c'){
+        next_counts[index(1, stage_index('1'), 0, 0)] += count;
+        ctx -> ccell_count += count;
+    }
+}
+
+/**
+ * Advance all the cells by one hour, consuming nutrients from the pool
+ *
+ * The per-cell model visits the cells in a random order, each cell starving (and dying) if the pool is below the
+ * critical levels when its turn comes, and healthy cells becoming or staying quiescent if it is below the quiescent
+ * levels. With each cell consuming the mean of the population, the pool only depends on the number of cells already
+ * visited: the first cells are fed, the next ones are starving and the last ones die. The share of each cohort in these
+ * three groups thus follows a multivariate hypergeometric distribution, drawn one cohort at a time.
+ *
+ * @param glucose The glucose pool, reduced by the consumption of the cells
+ * @param oxygen The oxygen pool, reduced by the consumption of the cells
+ * @param ctx The context of the simulation, whose population counters are updated
+ */
+void CohortPopulation::cycle(double & glucose, double & oxygen, SimContext * ctx){
+    int total = ctx -> hcell_count + ctx -> ccell_count;
+    if (total <= 0)
+        return;
+    // Consumption of a cell per hour, by type and by whether it starts the hour quiescent
+    const double glucose_use[2][2] = {{average_glucose_absorption, average_glucose_absorption * .75},
+                                      {average_cancer_glucose_absorption, average_cancer_glucose_absorption}};
+    const double oxygen_use[2][2] = {{average_oxygen_consumption, average_oxygen_consumption * .75},
+                                     {average_oxygen_consumption, average_oxygen_consumption}};
+    double glucose_demand = 0.0;
+    double oxygen_demand = 0.0;
+    double glucose_squares = 0.0; // Sums of the squared consumptions, for their variance
+    double oxygen_squares = 0.0;
+    int quiescent_stage = stage_index('q');
+    for (int type = 0; type < cohort_types; type++){
+        for (int stage = 0; stage < cohort_stage_count; stage++){
+            int cells = 0;
+            for (int k = index(type, stage, 0, 0); k < index(type, stage + 1, 0, 0); k++)
+                cells += counts[k];
+            double glucose_cell = glucose_use[type][stage == quiescent_stage];
+            double oxygen_cell = oxygen_use[type][stage == quiescent_stage];
+            glucose_demand += cells * glucose_cell;
+            oxygen_demand += cells * oxygen_cell;
+            glucose_squares += cells * glucose_cell * glucose_cell * (1.0 + efficiency_variance);
+            oxygen_squares += cells * oxygen_cell * oxygen_cell * (1.0 + efficiency_variance);
+        }
+    }
+    // Mean and standard deviation of the consumption of a cell taken at random
+    double glucose_mean = glucose_demand / total;
+    double oxygen_mean = oxygen_demand / total;
+    double glucose_deviation = sqrt(max(glucose_squares / total - glucose_mean * glucose_mean, 0.0));
+    double oxygen_deviation = sqrt(max(oxygen_squares / total - oxygen_mean * oxygen_mean, 0.0));
+    // Both nutrients are consumed by the same cells, with the same efficiency
+    double noise = ctx -> normal();
+    int alive = min(reach(glucose, glucose_mean, glucose_deviation, noise, critical_glucose_level, total),
+                    reach(oxygen, oxygen_mean, oxygen_deviation, noise, critical_oxygen_level, total));
+    int fed = min(alive, min(reach(glucose, glucose_mean, glucose_deviation, noise, quiescent_glucose_level, total),
+                             reach(oxygen, oxygen_mean, oxygen_deviation, noise, quiescent_oxygen_level, total)));
+    int neigh_count = total / 278;
+    int rest = total;
+    int fed_rest = fed;
+    int starving_rest = alive - fed;
+    double glucose_used = 0.0;
+    double oxygen_used = 0.0;
+    fill(next_counts.begin(), next_counts.end(), 0);
+    for (int type = 0; type < cohort_types; type++){
+        for (int stage = 0; stage < cohort_stage_count; stage++){
+            for (int repair = 0; repair < repair_levels; repair++){
+                for (int age = 0; age < cohort_ages; age++){
+                    int count = counts[index(type, stage, repair, age)];
+                    if (count == 0)
+                        continue;
+                    int fed_count = count;
+                    int starving_count = 0;
+                    if (fed_rest < rest){
+                        fed_count = hypergeometric(rest, count, fed_rest, ctx);
+                        starving_count = hypergeometric(rest - fed_rest, count - fed_count, starving_rest, ctx);
+                    }
+                    rest -= count;
+                    fed_rest -= fed_count;
+                    starving_rest -= starving_count;
+                    int dead = count - fed_count - starving_count;
+                    if (type == 0)
+                        ctx -> hcell_count -= dead;
+                    else
+                        ctx -> ccell_count -= dead;
+                    glucose_used += (fed_count + starving_count) * glucose_use[type][stage == quiescent_stage];
+                    oxygen_used += (fed_count + starving_count) * oxygen_use[type][stage == quiescent_stage];
+                    advance(type, stage, repair, age, fed_count, glucose, oxygen, neigh_count, ctx);
+                    advance(type, stage, repair, age, starving_count, critical_glucose_level, critical_oxygen_level,
+                            neigh_count, ctx);
+                }
+            }
+        }
+    }
+    counts.swap(next_counts);
+    // The same deviation from the mean consumption as the one which decided how many cells were fed
+    glucose -= max(glucose_used + sqrt((double) alive) * glucose_deviation * noise, 0.0);
+    oxygen -= max(oxygen_used + sqrt((double) alive) * oxygen_deviation * noise, 0.0);
+}
+
+/**
+ * Irradiate all the cells with the same dose
+ *
+ * The survivors of each cohort are drawn from a binomial distribution, and split between the hours of repair they
+ * gain, from 0 to 2 * repair_time, with the probabilities given by the rounding of HealthyCell::radiate_kernel.
+ *
+ * @param dose The dose of radiation (in grays)
+ * @param ctx The context of the simulation, whose population counters are updated
+ */
+void CohortPopulation::irradiate(double dose, SimContext * ctx){
+    SurvivalTable<HealthyCell> healthy_survival(dose);
+    SurvivalTable<CancerCell> cancer_survival(dose);
+    bool repairs = dose > 0.5;
+    if (repairs){
+        int max_repair = 0;
+        for (int repair = 0; repair < repair_levels; repair++){
+            for (int type = 0; type < cohort_types; type++){
+                for (int stage = 0; stage < cohort_stage_count; stage++){
+                    for (int age = 0; age < cohort_ages; age++){
+                        if (counts[index(type, stage, repair, age)] > 0)
+                            max_repair = repair;
+                    }
+                }
+            }
+        }
+        reserve_repair(max_repair + max_repair_increase + 1);
+    }
+    fill(next_counts.begin(), next_counts.end(), 0);
+    for (int type = 0; type < cohort_types; type++){
+        for (int stage = 0; stage < cohort_stage_count; stage++){
+            double survival = type == 0 ? healthy_survival.at(cohort_stages[stage])
+                                        : cancer_survival.at(cohort_stages[stage]);
+            for (int repair = 0; repair < repair_levels; repair++){
+                for (int age = 0; age < cohort_ages; age++){
+                    int count = counts[index(type, stage, repair, age)];
+                    if (count == 0)
+                        continue;
+                    int survivors = binomial(count, survival, ctx);
+                    if (type == 0)
+                        ctx -> hcell_count -= count - survivors;
+                    else
+                        ctx -> ccell_count -= count - survivors;
+                    if (!repairs){
+                        next_counts[index(type, stage, repair, age)] += survivors;
+                        continue;
+                    }
+                    // round(2 * u * repair_time) is 0 or 2 * repair_time with probability 1 / (4 * repair_time) each,
+                    // and any value in between with probability 1 / (2 * repair_time)
+                    double mass = 1.0;
+                    for (int increase = 0; increase < max_repair_increase && survivors > 0; increase++){
+                        double p = (increase == 0 ? 0.5 : 1.0) / (double) max_repair_increase;
+                        int gained = binomial(survivors, p / mass, ctx);
+                        next_counts[index(type, stage, repair + increase, age)] += gained;
+                        survivors -= gained;
+                        mass -= p;
+                    }
+                    next_counts[index(type, stage, repair + max_repair_increase, age)] += survivors;
+                }
+            }
+        }
+    }
+    counts.swap(next_counts);
+}
+
+/**
+ * Draw from the binomial distribution: number of successes among count trials of probability p
+ *
+ * Exact for small means, approximated by the normal distribution for large ones.
+ */
+int CohortPopulation::binomial(int count, double p, SimContext * ctx){
+    if (count <= 0 || p <= 0.0)
+        return 0;
+    if (p >= 1.0)
+        return count;
+    if (p > 0.5)
+        return count - binomial(count, 1.0 - p, ctx);
+    double mean = count * p;
+    if (count <= 16){
+        int successes = 0;
+        for (int k = 0; k < count; k++)
+            successes += ctx -> uniform() < p;
+        return successes;
+    }
+    if (mean < 16.0){
+        // Inversion of the cumulative distribution
+        double ratio = p / (1.0 - p);
+        double probability = pow(1.0 - p, count);
+        double u = ctx -> uniform();
+        int k = 0;
+        while (u > probability && k < count){
+            u -= probability;
+            probability *= ratio * (double) (count - k) / (double) (k + 1);
+            k++;
+        }
+        return k;
+    }
+    double draw = round(mean + sqrt(mean * (1.0 - p)) * ctx -> normal());
+    return (int) max(0.0, min(draw, (double) count));
+}
+
+/**
+ * Draw from the hypergeometric distribution: number of good items among draws items taken without replacement from
+ * total items, of which good are good
+ *
+ * Exact when either draws or good is small, approximated by the normal distribution otherwise.
+ */
+int CohortPopulation::hypergeometric(int total, int draws, int good, SimContext * ctx){
+    if (draws <= 0 || good <= 0)
+        return 0;
+    if (draws >= total)
+        return good;
+    if (good >= total)
+        return draws;
+    if (draws > total / 2) // The good items left behind are a draw of the others
+        return good - hypergeometric(total, total - draws, good, ctx);
+    if (good > total / 2) // Count the bad items drawn instead
+        return draws - hypergeometric(total, draws, total - good, ctx);
+    int small = min(draws, good);
+    int large = max(draws, good);
+    if (small <= 64){
+        // The roles of the draws and the good items are symmetric, so the smaller is drawn one by one
+        int found = 0;
+        int left = total;
+        for (int k = 0; k < small; k++){
+            if (ctx -> uniform() * left < large - found)
+                found++;
+            left--;
+        }
+        return found;
+    }
+    double mean = (double) draws * good / total;
+    double variance = mean * (1.0 - (double) good / total) * (double) (total - draws) / (double) (total - 1);
+    double draw = round(mean + sqrt(variance) * ctx -> normal());
+    return (int) max(0.0, min(draw, (double) small));
+}
@@ -0,0 +1,40 @@
+#ifndef RADIO_RL_COHORT_POPULATION_H
+#define RADIO_RL_COHORT_POPULATION_H
+
+#include <vector>
+#include "sim_context.h"
+
+/**
+ * Population of healthy and cancer cells sharing a single pool of nutrients, kept as the number of cells in each
+ * cohort of identical cells instead of one object per cell
+ *
+ * A cohort is a (type, stage, age, repair) bucket. As the cells of a cohort follow the same kernels (see cell_kernels.h),
+ * every cohort is advanced as a whole, the only random events being which cells starve when the nutrients run out
+ * during an hour and which cells survive an irradiation. These are drawn for the whole cohort from the distributions
+ * the per-cell model would give (hypergeometric and binomial), so that the trajectories are statistically equivalent
+ * to the ones of ScalarModel with individual cells, at a cost that does not depend on the number of cells.
+ *
+ * The nutrient efficiency of each cell is not kept: the consumption of the cells visited during an hour is drawn as a
+ * whole, from the normal approximation of the sum of their efficiencies.
+ */
+class CohortPopulation {
+public:
+    CohortPopulation();
+    void clear();
+    void add(char type, char stage, int count, SimContext * ctx);
+    void cycle(double & glucose, double & oxygen, SimContext * ctx);
+    void irradiate(double dose, SimContext * ctx);
+private:
+    int index(int type, int stage, int repair, int age);
+    void advance(int type, int stage, int repair, int age, int count, double glucose, double oxygen,
+                 int neigh_count, SimContext * ctx);
+    void reserve_repair(int levels);
+    static int binomial(int count, double p, SimContext * ctx);
+    static int hypergeometric(int total, int draws, int good, SimContext * ctx);
+    static int reach(double pool, double mean, double deviation, double noise, double level, int total);
+    int repair_levels; // Size of the repair dimension of the cohorts, 0 ... repair_levels - 1 hours of repair
+    std::vector<int> counts; // Number of cells of each cohort, see index
+    std::vector<int> next_counts; // Cohorts being built by cycle and irradiate
+};
+
+#endif //RADIO_RL_COHORT_POPULATION_H
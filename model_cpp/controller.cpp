@@ -15,14 +15,14 @@ using namespace std;
  * @param ysize The number of columns of the grid
  */
 Controller::Controller(Grid *grid, int hcells, int xsize, int ysize): xsize(xsize), ysize(ysize),  tick(0), self_grid(false), grid(grid), oar(nullptr)  {
-    HealthyCell::count = 0;
-    CancerCell::count = 0;
+    ctx = grid -> get_context();
+    ctx -> reset_counts();
     char stages[5] = {'1', 's', '2', 'm', 'q'};
     for (int i = 0; i < hcells; i++){
-        Cell * new_cell = new HealthyCell(stages[rand() % 5]); //We create a new cell and put it in a random stage
-        grid -> addCell(rand() % xsize, rand() % ysize, new_cell, 'h'); //We add that cell on a random pixel of the grid
+        char stage = stages[ctx -> rand_int() % 5]; //We create a new cell in a random stage
+        grid -> addCell(ctx -> rand_int() % xsize, ctx -> rand_int() % ysize, 'h', stage); //We add that cell on a random pixel of the grid
     }
-    grid -> addCell(xsize / 2, ysize / 2, new CancerCell(stages[rand() % 4]), 'c'); //We add the unique cancer cell in the center
+    grid -> addCell(xsize / 2, ysize / 2, 'c', stages[ctx -> rand_int() % 4]); //We add the unique cancer cell in the center
 }
 
 /**
@@ -34,22 +34,21 @@ Controller::Controller(Grid *grid, int hcells, int xsize, int ysize): xsize(xsiz
  * @param xsize The number of rows of the grid
  * @param ysize The number of columns of the grid
  * @param sources_num The number of nutrient sources to put on the grid
+ * @param seed The seed of the random streams of the simulation
  */
-Controller::Controller(int hcells, int xsize, int ysize, int sources_num): xsize(xsize), ysize(ysize), tick(0), self_grid(true), oar(nullptr) {
-    HealthyCell::count = 0;
-    CancerCell::count = 0;
-    grid = new Grid(xsize, ysize, sources_num);
+Controller::Controller(int hcells, int xsize, int ysize, int sources_num, unsigned int seed): xsize(xsize), ysize(ysize), tick(0), self_grid(true), oar(nullptr) {
+    grid = new Grid(xsize, ysize, sources_num, seed);
+    ctx = grid -> get_context();
     char stages[5] = {'1', 's', '2', 'm', 'q'};
     float prob = 100.0 * (float) hcells / (xsize * ysize);
     for (int i = 0; i < xsize; i++){
         for(int j = 0; j < ysize; j++){
-            if (rand() % 100 < prob){
-                Cell * new_cell = new HealthyCell(stages[rand() % 5]);
-                grid -> addCell(i, j, new_cell, 'h');
+            if (ctx -> rand_int() % 100 < prob){
+                grid -> addCell(i, j, 'h', stages[ctx -> rand_int() % 5]);
             }
         }
     }
-    grid -> addCell(xsize / 2, ysize / 2, new CancerCell(stages[rand() % 4]), 'c');
+    grid -> addCell(xsize / 2, ysize / 2, 'c', stages[ctx -> rand_int() % 4]);
 
 }
 
@@ -66,11 +65,9 @@ Controller::Controller(int hcells, int xsize, int ysize, int sources_num): xsize
  * @param sources_num The number of nutrient sources to put on the grid
  * @param x1, y1 The first corner of the OARZone rectangle
  * @param x2, y2 The opposite corner of the OARZone rectangle
+ * @param seed The seed of the random streams of the simulation
  */
-Controller::Controller(int hcells, int xsize, int ysize, int sources_num, int x1, int x2, int y1, int y2):xsize(xsize), ysize(ysize), tick(0), self_grid(true){
-    HealthyCell::count = 0;
-    CancerCell::count = 0;
-    OARCell::count = 0;
+Controller::Controller(int hcells, int xsize, int ysize, int sources_num, int x1, int x2, int y1, int y2, unsigned int seed):xsize(xsize), ysize(ysize), tick(0), self_grid(true){
     if(x1 > x2){
         int temp = x1;
         x1 = x2;
@@ -86,25 +83,56 @@ Controller::Controller(int hcells, int xsize, int ysize, int sources_num, int x1
     oar -> x2 = x2;
     oar -> y1 = y1;
     oar -> y2 = y2;
-    grid = new Grid(xsize, ysize, sources_num, oar);
+    grid = new Grid(xsize, ysize, sources_num, oar, seed);
+    ctx = grid -> get_context();
     char stages[5] = {'1', 's', '2', 'm', 'q'};
     for(int x = x1; x < x2; x++){
         for(int y = y1; y < y2; y++){
-            Cell * new_cell = new OARCell('q');
-            grid -> addCell(x, y, new_cell, 'o');
+            grid -> addCell(x, y, 'o', 'q');
         }
     }
     for (int i = 0; i < hcells; i++){
-        int x = rand() % xsize;
-        int y = rand() % ysize;
+        int x = ctx -> rand_int() % xsize;
+        int y = ctx -> rand_int() % ysize;
         if (!(x >= x1 && x < x2 && y >= y1 && y < y2)){
-            Cell * new_cell = new HealthyCell(stages[rand() % 5]);
-            grid -> addCell(x, y, new_cell, 'h');
+            grid -> addCell(x, y, 'h', stages[ctx -> rand_int() % 5]);
         }
     }
-    grid -> addCell(xsize / 2, ysize / 2, new CancerCell(stages[rand() % 4]), 'c');
+    grid -> addCell(xsize / 2, ysize / 2, 'c', stages[ctx -> rand_int() % 4]);
 
 }
+/**
+ * Copy constructor of a Controller
+ *
+ * Makes a deep copy of the simulation (grid, cells, nutrient sources and random streams). The copy owns its grid, even
+ * if other was built on a grid provided by the caller.
+ *
+ * @param other The controller to copy
+ */
+Controller::Controller(const Controller & other):xsize(other.xsize), ysize(other.ysize), tick(other.tick),
+                                                 self_grid(true), oar(nullptr){
+    grid = new Grid(*other.grid);
+    if (other.oar){
+        oar = new OARZone(*other.oar);
+        grid -> set_oar_zone(oar);
+    }
+    ctx = grid -> get_context();
+}
+
+/**
+ * Constructor of a Controller around an existing simulation, used when loading a checkpoint
+ *
+ * @param grid The grid of the simulation, which the Controller takes ownership of
+ * @param oar The OAR zone of the grid (or nullptr), which the Controller takes ownership of
+ * @param xsize The number of rows of the grid
+ * @param ysize The number of columns of the grid
+ * @param tick The current tick of the simulation
+ */
+Controller::Controller(Grid * grid, OARZone * oar, int xsize, int ysize, int tick):xsize(xsize), ysize(ysize), tick(tick),
+                                                                                 self_grid(true), grid(grid), oar(oar){
+    ctx = grid -> get_context();
+}
+
 /**
  * Destructor of the controller
  */
@@ -130,6 +158,44 @@ void Controller::go() {
     }
 }
 
+/**
+ * Return an exact copy of the simulation, which will evolve exactly like this one if given the same treatment
+ *
+ * Useful to keep a simulation that has gone through the initial growth, and start episodes from it without simulating
+ * the growth again.
+ */
+Controller * Controller::snapshot(){
+    return new Controller(*this);
+}
+
+/**
+ * Return a copy of the simulation whose random streams restart from seed, so that it diverges from this one
+ *
+ * @param seed The seed of the random streams of the copy
+ */
+Controller * Controller::clone(unsigned int seed){
+    Controller * copy = new Controller(*this);
+    copy -> reseed(seed);
+    return copy;
+}
+
+/**
+ * Restart the random streams of the simulation from seed
+ */
+void Controller::reseed(unsigned int seed){
+    ctx -> reseed(seed);
+}
+
+/**
+ * Choose how many threads are used to advance the cells by one hour, see Grid::set_cycle_threads
+ *
+ * @param num_threads The number of threads, 1 for the original single-threaded simulation
+ * @param tile_size The side in pixels of the tiles processed by each thread
+ */
+void Controller::set_cycle_threads(int num_threads, int tile_size){
+    grid -> set_cycle_threads(num_threads, tile_size);
+}
+
 /**
  * Irradiate the tumor with a certain dose
  *
@@ -193,19 +259,78 @@ int Controller::pixel_type(int x, int y){
 }
 
 /**
- * Return the current glucose array
+ * Return a view of the current glucose field, see Grid::currentGlucose
  */
-double ** Controller::currentGlucose(){
+FieldView<double> Controller::currentGlucose(){
     return grid->currentGlucose();
 }
 
 /**
- * Return the current oxygen array
+ * Return a view of the current oxygen field, see Grid::currentGlucose
  */
-double ** Controller::currentOxygen(){
+FieldView<double> Controller::currentOxygen(){
     return grid->currentOxygen();
 }
 
+/**
+ * Return the dose received by each pixel during the last irradiation, see Grid::currentDose
+ */
+double * Controller::currentDose(){
+    return grid->currentDose();
+}
+
+/**
+ * Write the state given to the agent into out, as a row-major (xsize, ysize, 3) array, in a single pass over the grid
+ *
+ * The channels of each pixel are its segmentation ((pixel_type + 1) / 2, as in CellEnvironment.observe), its glucose and
+ * its oxygen, each multiplied by the corresponding scale.
+ *
+ * @param out The array to fill, of size xsize * ysize * 3
+ * @param scales The 3 factors applied to the channels
+ */
+void Controller::observe_state(float * out, const double * scales){
+    fill_state(out, scales);
+}
+
+/**
+ * Write the state given to the agent into out as bytes, see observe_state(float *, const double *)
+ *
+ * Scaled values are rounded to the nearest integer and clamped to [0, 255].
+ */
+void Controller::observe_state(unsigned char * out, const double * scales){
+    fill_state(out, scales);
+}
+
+/**
+ * Convert a scaled channel value to the element type of an observation
+ */
+static inline float to_channel(double value, float *){
+    return (float) value;
+}
+
+static inline unsigned char to_channel(double value, unsigned char *){
+    if (value <= 0.0)
+        return 0;
+    if (value >= 255.0)
+        return 255;
+    return (unsigned char) (value + 0.5);
+}
+
+template <typename T>
+void Controller::fill_state(T * out, const double * scales){
+    FieldView<double> glucose = grid -> currentGlucose();
+    FieldView<double> oxygen = grid -> currentOxygen();
+    double type_scale = 0.5 * scales[0];
+    T * tag = 0;
+    for (int i = 0; i < xsize; i++){
+        for (int j = 0; j < ysize; j++){
+            *out++ = to_channel((grid -> pixel_type(i, j) + 1) * type_scale, tag);
+            *out++ = to_channel(glucose[i][j] * scales[1], tag);
+            *out++ = to_channel(oxygen[i][j] * scales[2], tag);
+        }
+    }
+}
+
 /**
  * Return the current tumor's radius
  */
@@ -214,19 +339,31 @@ double Controller::tumor_radius(){
 }
 
 /**
- * Simulate a basic treatment to ensure that there are no obvious bugs/crashes
+ * Return the number of HealthyCells in this simulation
  */
-int main(){
-    srand(42);
-    Controller * controller = new Controller(1000, 50, 50, 50, 5, 15, 5, 15);
-    cout << "Tick : " << 0 << " HCells : " << HealthyCell::count << " CCells : " << CancerCell::count << " OARCells : " << OARCell::count << endl;
-    for (int i = 1; i <= 2000; i++){
-        controller->go();
-        if (i > 400 && i % 24 == 0)
-            controller -> irradiate(2.0);
-        cout << "Tick : " << i << " HCells : " << HealthyCell::count << " CCells : " << CancerCell::count  << " OARCells : " << OARCell::count << endl;
-    }
-    delete controller;
+int Controller::hcell_count(){
+    return ctx -> hcell_count;
+}
+
+/**
+ * Return the number of CancerCells in this simulation
+ */
+int Controller::ccell_count(){
+    return ctx -> ccell_count;
+}
+
+/**
+ * Return the number of OARCells in this simulation
+ */
+int Controller::oar_count(){
+    return ctx -> oar_count;
+}
+
+/**
+ * Return the statistics of this simulation (time per phase and counts of events), which the caller may reset
+ */
+SimStats * Controller::get_stats(){
+    return &ctx -> stats;
 }
 
 double Controller::get_center_x(){
@@ -6,11 +6,17 @@
 #include "cell.h"
 
 class Controller {
+    friend class Checkpoint;
 public:
     Controller(Grid * grid, int hcells, int xsize, int ysize);
-    Controller(int hcells, int xsize, int ysize, int sources_num);
-    Controller(int hcells, int xsize, int ysize, int sources_num, int x1, int x2, int y1, int y2);
+    Controller(int hcells, int xsize, int ysize, int sources_num, unsigned int seed);
+    Controller(int hcells, int xsize, int ysize, int sources_num, int x1, int x2, int y1, int y2, unsigned int seed);
+    Controller(const Controller & other);
     ~Controller();
+    Controller * snapshot();
+    Controller * clone(unsigned int seed);
+    void reseed(unsigned int seed);
+    void set_cycle_threads(int num_threads, int tile_size);
     void irradiate(double dose);
     void irradiate_center(double dose);
     void irradiate(double dose, double radius);
@@ -18,17 +24,27 @@ public:
     void go();
     int pixel_density(int x, int y);
     int pixel_type(int x, int y);
-    double ** currentGlucose();
-    double ** currentOxygen();
+    FieldView<double> currentGlucose();
+    FieldView<double> currentOxygen();
+    double * currentDose();
+    void observe_state(float * out, const double * scales);
+    void observe_state(unsigned char * out, const double * scales);
     double tumor_radius();
+    int hcell_count();
+    int ccell_count();
+    int oar_count();
+    SimStats * get_stats();
     int xsize, ysize;
     int tick;
     double get_center_x();
     double get_center_y();
 private:
+    template <typename T> void fill_state(T * out, const double * scales);
+    Controller(Grid * grid, OARZone * oar, int xsize, int ysize, int tick);
     bool self_grid;
     Grid * grid;
     OARZone * oar;
+    SimContext * ctx;
 };
 
 
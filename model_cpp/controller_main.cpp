@@ -0,0 +1,27 @@
+#include "controller.h"
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Simulate a basic treatment to ensure that there are no obvious bugs/crashes
+ *
+ * This 2000 tick run is also the canonical workload of the benchmarks and of the profile-guided builds (see Makefile).
+ * The populations are written to the standard output after every tick, and the time taken to the standard error.
+ */
+int main(){
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Controller * controller = new Controller(1000, 50, 50, 50, 5, 15, 5, 15, 42);
+    cout << "Tick : " << 0 << " HCells : " << controller -> hcell_count() << " CCells : " << controller -> ccell_count() << " OARCells : " << controller -> oar_count() << endl;
+    for (int i = 1; i <= 2000; i++){
+        controller->go();
+        if (i > 400 && i % 24 == 0)
+            controller -> irradiate(2.0);
+        cout << "Tick : " << i << " HCells : " << controller -> hcell_count() << " CCells : " << controller -> ccell_count()  << " OARCells : " << controller -> oar_count() << endl;
+    }
+    delete controller;
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cerr << "Elapsed time : " << elapsed.count() << " s" << endl;
+    return 0;
+}
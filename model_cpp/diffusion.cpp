@@ -0,0 +1,187 @@
+#include "diffusion.h"
+#include <cstddef>
+#include <cstring>
+
+#if !defined(DIFFUSION_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DIFFUSION_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// The sum for each pixel is done in the same order in every kernel, and must not be turned into fused multiply-adds,
+// so that the simulation gives the same results whichever kernel the processor supports
+#pragma GCC optimize ("fp-contract=off")
+
+/*
+ * A row kernel computes one row of a diffused field. above, row and below point to the first pixel of copies of the
+ * previous, current and next rows of the field, with the pixel of the halo on each side. Rows outside of the grid are
+ * all zeros, so that the borders need no special case.
+ */
+typedef void (*RowKernel)(double * out, const double * above, const double * row, const double * below, int ysize,
+                          double keep, double share);
+
+/**
+ * Scalar row kernel, used for the columns left over by the vectorized kernels and on processors without AVX2
+ *
+ * @param out The row of the field in which the result is written
+ * @param above, row, below Padded copies of the rows i-1, i and i+1 of the field before diffusion
+ * @param ysize The number of columns of the grid
+ * @param keep The share of each pixel's amount that stays on the pixel
+ * @param share The share of each pixel's amount given to each of its 8 neighbours
+ */
+static void diffuse_row_scalar(double * out, const double * above, const double * row, const double * below, int ysize,
+                               double keep, double share){
+    for (int j = 0; j < ysize; j++){
+        double value = keep * row[j];
+        value += share * row[j - 1]; // shift right
+        value += share * row[j + 1]; // shift left
+        value += share * above[j]; // shift down
+        value += share * below[j]; // shift up
+        value += share * below[j + 1]; // up left
+        value += share * above[j - 1]; // down right
+        value += share * below[j - 1]; // up right
+        value += share * above[j + 1]; // down left
+        out[j] = value;
+    }
+}
+
+#ifdef DIFFUSION_X86_SIMD
+
+/**
+ * AVX2 row kernel, computes 4 pixels at a time (see diffuse_row_scalar)
+ */
+__attribute__((target("avx2")))
+static void diffuse_row_avx2(double * out, const double * above, const double * row, const double * below, int ysize,
+                             double keep, double share){
+    __m256d keep_v = _mm256_set1_pd(keep);
+    __m256d share_v = _mm256_set1_pd(share);
+    int j = 0;
+    for (; j + 4 <= ysize; j += 4){
+        __m256d value = _mm256_mul_pd(keep_v, _mm256_loadu_pd(row + j));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(row + j - 1)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(row + j + 1)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(above + j)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(below + j)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(below + j + 1)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(above + j - 1)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(below + j - 1)));
+        value = _mm256_add_pd(value, _mm256_mul_pd(share_v, _mm256_loadu_pd(above + j + 1)));
+        _mm256_storeu_pd(out + j, value);
+    }
+    diffuse_row_scalar(out + j, above + j, row + j, below + j, ysize - j, keep, share);
+}
+
+/**
+ * AVX-512 row kernel, computes 8 pixels at a time (see diffuse_row_scalar)
+ */
+__attribute__((target("avx512f")))
+static void diffuse_row_avx512(double * out, const double * above, const double * row, const double * below, int ysize,
+                               double keep, double share){
+    __m512d keep_v = _mm512_set1_pd(keep);
+    __m512d share_v = _mm512_set1_pd(share);
+    int j = 0;
+    for (; j + 8 <= ysize; j += 8){
+        __m512d value = _mm512_mul_pd(keep_v, _mm512_loadu_pd(row + j));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(row + j - 1)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(row + j + 1)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(above + j)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(below + j)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(below + j + 1)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(above + j - 1)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(below + j - 1)));
+        value = _mm512_add_pd(value, _mm512_mul_pd(share_v, _mm512_loadu_pd(above + j + 1)));
+        _mm512_storeu_pd(out + j, value);
+    }
+    diffuse_row_avx2(out + j, above + j, row + j, below + j, ysize - j, keep, share);
+}
+
+#endif
+
+/**
+ * Choose the widest row kernel supported by the processor
+ */
+static RowKernel select_row_kernel(){
+#ifdef DIFFUSION_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return diffuse_row_avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return diffuse_row_avx2;
+#endif
+    return diffuse_row_scalar;
+}
+
+static RowKernel row_kernel(){
+    static RowKernel kernel = select_row_kernel();
+    return kernel;
+}
+
+/**
+ * Return the name of the row kernel used on this processor ("avx512", "avx2" or "scalar")
+ */
+const char * diffusion_kernel_name(){
+#ifdef DIFFUSION_X86_SIMD
+    if (row_kernel() == diffuse_row_avx512)
+        return "avx512";
+    if (row_kernel() == diffuse_row_avx2)
+        return "avx2";
+#endif
+    return "scalar";
+}
+
+/**
+ * Return the number of doubles needed for the work space of diffuse_fields on a grid with ysize columns
+ */
+int diffusion_lines_size(int ysize){
+    return 6 * (ysize + 2);
+}
+
+/**
+ * Diffuse glucose and oxygen in place, in a single sweep over both fields
+ *
+ * Each pixel keeps (1 - diff_factor) of its amount and gives an eighth of diff_factor of it to each of its neighbours,
+ * what would go outside of the grid is lost.
+ *
+ * The fields are surrounded by a halo of zeros (see Field), which stands for the pixels outside of the grid so that the
+ * borders need no special case.
+ *
+ * @param glucose Pixel (0, 0) of the glucose field, whose rows are stride values apart
+ * @param oxygen Pixel (0, 0) of the oxygen field, stored the same way
+ * @param xsize The number of rows of the grid
+ * @param ysize The number of columns of the grid
+ * @param stride The number of values from the start of a row of the fields to the start of the next one
+ * @param diff_factor The share of each pixel's glucose and oxygen that should be spread to neighbouring pixels
+ * @param lines Work space of diffusion_lines_size(ysize) doubles
+ */
+void diffuse_fields(double * glucose, double * oxygen, int xsize, int ysize, int stride, double diff_factor,
+                    double * lines){
+    RowKernel kernel = row_kernel();
+    double keep = 1.0 - diff_factor;
+    double share = 0.125 * diff_factor;
+    int width = ysize + 2;
+    size_t line_bytes = width * sizeof(double); // A row and its halo on each side
+    double * glu_rows[3];
+    double * oxy_rows[3];
+    for (int k = 0; k < 3; k++){
+        glu_rows[k] = lines + k * width + 1;
+        oxy_rows[k] = lines + (3 + k) * width + 1;
+    }
+    memcpy(glu_rows[0] - 1, glucose - stride - 1, line_bytes); // The halo above the grid
+    memcpy(oxy_rows[0] - 1, oxygen - stride - 1, line_bytes);
+    memcpy(glu_rows[1] - 1, glucose - 1, line_bytes);
+    memcpy(oxy_rows[1] - 1, oxygen - 1, line_bytes);
+    for (int i = 0; i < xsize; i++){
+        // Keep a copy of the next row before it gets overwritten, the halo below the grid for the last one
+        memcpy(glu_rows[2] - 1, glucose + (ptrdiff_t) (i + 1) * stride - 1, line_bytes);
+        memcpy(oxy_rows[2] - 1, oxygen + (ptrdiff_t) (i + 1) * stride - 1, line_bytes);
+        kernel(glucose + (ptrdiff_t) i * stride, glu_rows[0], glu_rows[1], glu_rows[2], ysize, keep, share);
+        kernel(oxygen + (ptrdiff_t) i * stride, oxy_rows[0], oxy_rows[1], oxy_rows[2], ysize, keep, share);
+        double * temp = glu_rows[0]; // The current row becomes the row above, and the next row the current one
+        glu_rows[0] = glu_rows[1];
+        glu_rows[1] = glu_rows[2];
+        glu_rows[2] = temp;
+        temp = oxy_rows[0];
+        oxy_rows[0] = oxy_rows[1];
+        oxy_rows[1] = oxy_rows[2];
+        oxy_rows[2] = temp;
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef RADIO_RL_DIFFUSION_H
+#define RADIO_RL_DIFFUSION_H
+
+int diffusion_lines_size(int ysize);
+
+void diffuse_fields(double * glucose, double * oxygen, int xsize, int ysize, int stride, double diff_factor,
+                    double * lines);
+
+const char * diffusion_kernel_name();
+
+#endif //RADIO_RL_DIFFUSION_H
@@ -0,0 +1,83 @@
+#include "dose_map.h"
+#include <algorithm>
+#include <math.h>
+
+
+/**
+ * Computes the dose depending on the distance to the tumor's center
+ *
+ * @param rad Radius of the radiation (95 % of the full dose at 1 radius from the center)
+ * @param x Distance from the center
+ * @return The Euclidean distance between the two points
+ */
+double conv(double rad, double x){
+    double denom = 3.8;//sqrt(2) * 2.7
+    return erf((rad - x)/denom) - erf((-rad - x) / denom);
+}
+
+/**
+ * Return the factor by which the profile of a beam is multiplied so that its center receives the given dose
+ */
+double get_multiplicator(double dose, double radius){
+    return dose / conv(14, 0);
+}
+
+/**
+ * Constructor of DoseProfile, the profile is empty until set_radius is called
+ */
+DoseProfile::DoseProfile(): radius(0.0), limit(0) {}
+
+/**
+ * Prepare the profile of a beam of the given radius
+ *
+ * The beam reaches the pixels closer than 3 radii from its center. Entries already computed for the same radius are
+ * kept.
+ *
+ * @param radius Radius of the radiation (95 % of the full dose at 1 radius from the center)
+ * @param max_squared_distance The largest squared distance that will be looked up
+ */
+void DoseProfile::set_radius(double radius, int max_squared_distance){
+    if (radius != this -> radius){
+        this -> radius = radius;
+        table.clear();
+    }
+    double cutoff = 3 * radius;
+    if (!(radius > 0)){
+        limit = 0;
+        return;
+    }
+    limit = (int) std::min(ceil(cutoff * cutoff), (double) max_squared_distance + 1.0);
+    while (limit > 0 && !(sqrt(limit - 1) < cutoff)) // Same test as on the distance itself, whatever the rounding
+        limit--;
+    while (limit <= max_squared_distance && sqrt(limit) < cutoff)
+        limit++;
+    if ((int) table.size() < limit)
+        table.resize(limit, -1.0);
+}
+
+/**
+ * Return whether the beam reaches the pixels at the given squared distance from its center
+ */
+bool DoseProfile::reaches(int squared_distance){
+    return squared_distance < limit;
+}
+
+/**
+ * Return the largest offset along a single axis that the beam reaches, or -1 if it reaches nothing
+ */
+int DoseProfile::reach(){
+    int offset = -1;
+    while ((offset + 1) * (offset + 1) < limit)
+        offset++;
+    return offset;
+}
+
+/**
+ * Return the profile at a squared distance reached by the beam, to be multiplied by get_multiplicator
+ */
+double DoseProfile::at(int squared_distance){
+    double & value = table[squared_distance];
+    if (value < 0)
+        value = conv(14.0, sqrt(squared_distance) * 10.0 / radius);
+    return value;
+}
@@ -0,0 +1,30 @@
+#ifndef RADIO_RL_DOSE_MAP_H
+#define RADIO_RL_DOSE_MAP_H
+
+#include <vector>
+
+double conv(double rad, double x);
+
+double get_multiplicator(double dose, double radius);
+
+/**
+ * Radial profile of a beam of radiation of a given radius, tabulated by squared distance from its center
+ *
+ * The distance between a pixel and the center of the beam is measured with whole numbers of rows and columns, so the
+ * squared distances are integers and index the table directly. Entries are computed the first time they are needed,
+ * and kept for as long as the radius stays the same.
+ */
+class DoseProfile {
+public:
+    DoseProfile();
+    void set_radius(double radius, int max_squared_distance);
+    bool reaches(int squared_distance);
+    int reach();
+    double at(int squared_distance);
+private:
+    double radius;
+    int limit; // First squared distance that the beam does not reach
+    std::vector<double> table; // Negative until computed
+};
+
+#endif //RADIO_RL_DOSE_MAP_H
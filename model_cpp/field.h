@@ -0,0 +1,150 @@
+#ifndef RADIO_RL_FIELD_H
+#define RADIO_RL_FIELD_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+/**
+ * View of a 2D field of values: xsize rows of ysize values, each row starting stride values after the previous one
+ *
+ * view[i][j] is the value of pixel (i, j), as with the arrays of row pointers that the fields used to be.
+ */
+template <typename T>
+struct FieldView {
+    T * origin; // Value of pixel (0, 0)
+    int xsize;
+    int ysize;
+    int stride;
+    T * operator[](int i) const;
+};
+
+/**
+ * Values of a 2D field of a Grid (glucose, oxygen, neighbour counts) in a single aligned allocation
+ *
+ * The xsize rows of ysize pixels are surrounded by a halo of one pixel on every side, so that the 8 neighbours of any
+ * pixel of the grid can be read or written without checking the bounds: rows -1 and xsize, and columns -1 and ysize,
+ * are valid indices. The halo starts at zero and is not part of the field, what is written there is simply ignored.
+ * Rows are padded so that each of them starts on a 32 byte boundary, and the values never move for the whole life of
+ * the field.
+ */
+template <typename T>
+class Field {
+public:
+    Field(int xsize, int ysize);
+    Field(const Field & other);
+    Field & operator=(const Field & other) = delete;
+    ~Field();
+    T * operator[](int i);
+    T * data();
+    int stride();
+    FieldView<T> view();
+    void fill(T value);
+    static int row_stride(int ysize);
+private:
+    static const int align = 32 / sizeof(T); // Values per 32 bytes, which is also the padding before each row
+    int xsize;
+    int ysize;
+    int padded_ysize;
+    T * block; // Rows -1 to xsize, padding included
+    T * origin; // Pixel (0, 0) in block
+    void allocate();
+};
+
+template <typename T>
+inline T * FieldView<T>::operator[](int i) const {
+    return origin + (ptrdiff_t) i * stride;
+}
+
+/**
+ * Number of values from the start of a row to the start of the next one, for rows of ysize pixels
+ */
+template <typename T>
+inline int Field<T>::row_stride(int ysize){
+    return (align + ysize + 1 + align - 1) / align * align;
+}
+
+/**
+ * Constructor of a Field whose pixels and halo are all zero
+ *
+ * @param xsize The number of rows of the grid
+ * @param ysize The number of columns of the grid
+ */
+template <typename T>
+Field<T>::Field(int xsize, int ysize): xsize(xsize), ysize(ysize), padded_ysize(row_stride(ysize)) {
+    allocate();
+    memset(block, 0, (size_t) (xsize + 2) * padded_ysize * sizeof(T));
+}
+
+/**
+ * Copy constructor of Field, copying the halo as well
+ */
+template <typename T>
+Field<T>::Field(const Field & other): xsize(other.xsize), ysize(other.ysize), padded_ysize(other.padded_ysize) {
+    allocate();
+    memcpy(block, other.block, (size_t) (xsize + 2) * padded_ysize * sizeof(T));
+}
+
+template <typename T>
+Field<T>::~Field(){
+    free(block);
+}
+
+/**
+ * Allocate the block of the rows, aligned on 32 bytes
+ */
+template <typename T>
+void Field<T>::allocate(){
+    void * memory = nullptr;
+    if (posix_memalign(&memory, 32, (size_t) (xsize + 2) * padded_ysize * sizeof(T)) != 0)
+        throw std::bad_alloc();
+    block = (T *) memory;
+    origin = block + padded_ysize + align; // Skip row -1, and the padding before row 0 whose last value is its halo
+}
+
+/**
+ * Return row i of the field, from -1 to xsize, which can be indexed from -1 to ysize
+ */
+template <typename T>
+inline T * Field<T>::operator[](int i){
+    return origin + (ptrdiff_t) i * padded_ysize;
+}
+
+/**
+ * Return pixel (0, 0) of the field, row i starting i * stride() values further
+ */
+template <typename T>
+inline T * Field<T>::data(){
+    return origin;
+}
+
+/**
+ * Return the number of values from the start of a row to the start of the next one
+ */
+template <typename T>
+inline int Field<T>::stride(){
+    return padded_ysize;
+}
+
+/**
+ * Return a view of the pixels of the field, without the halo
+ */
+template <typename T>
+inline FieldView<T> Field<T>::view(){
+    return FieldView<T>{origin, xsize, ysize, padded_ysize};
+}
+
+/**
+ * Set every pixel of the field to a value, leaving the halo untouched
+ */
+template <typename T>
+void Field<T>::fill(T value){
+    for (int i = 0; i < xsize; i++){
+        T * row = (*this)[i];
+        for (int j = 0; j < ysize; j++)
+            row[j] = value;
+    }
+}
+
+#endif //RADIO_RL_FIELD_H
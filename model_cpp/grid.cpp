@@ -1,5 +1,9 @@
 #include <algorithm>
 #include "grid.h"
+#include "cell_kernels.h"
+#include "diffusion.h"
+#include "dose_map.h"
+#include "thread_pool.h"
 #include <assert.h> 
 #include <math.h> 
 #include <iostream>
@@ -8,16 +12,28 @@
 /**
  * Constructor of CellList
  *
- * CellLists are linked lists of CellNodes that are on each pixel of the Grid
+ * CellLists are linked lists of CellNodes, used by the ScalarModel (the cells of a Grid are kept in a CellStore)
  *
  */
-CellList::CellList():head(nullptr), tail(nullptr), size(0), oar_count(0), ccell_count(0) {}
+CellList::CellList():head(nullptr), tail(nullptr), size(0), pool(nullptr) {}
+
+/**
+ * Constructor of a CellList whose cells and nodes live in a CellPool
+ *
+ * The cells added to the list must have been made with pool -> make_cell. Destroying the list does not give back their
+ * slots: the pool must be cleared (or destroyed) once the list is gone.
+ *
+ * @param pool The pool of the cells and nodes of the list
+ */
+CellList::CellList(CellPool * pool):head(nullptr), tail(nullptr), size(0), pool(pool) {}
 
 /**
  * Destructor of CellList
  *
  */
 CellList::~CellList() {
+    if (pool) // The whole population is dropped at once by clearing the pool
+        return;
     CellNode * current = head;
     CellNode * next;
     while (current){ // Delete all the CellNodes and Cells in the CellList
@@ -52,10 +68,6 @@ void CellList::add(CellNode * newNode, char type){
         newNode -> next = head;
         head = newNode;
     }
-    if (type == 'o')
-        oar_count++;
-    if (type == 'c')
-        ccell_count++;
     size++;
 }
 
@@ -67,32 +79,13 @@ void CellList::add(CellNode * newNode, char type){
  * @param type The type of the Cell
  */
 void CellList::add(Cell *cell, char type) {
-    CellNode * newNode = new CellNode;
+    CellNode * newNode = pool ? new (pool -> allocate()) CellNode : new CellNode;
     assert(cell);
     newNode -> cell = cell;
     newNode -> type = type;
     add(newNode, type);
 }
 
-/**
- * Create a CellNode container for the Cell and add it to the CellList, with the coordinates of the cell on the grid
- *
- * @param cell The cell that we want to add to the CellList
- * @param type The type of the Cell
- * @param x The x coordinate of the cell on the grid
- * @param y The y coordinate of the cell on the grid
- */
-void CellList::add(Cell *cell, char type, int x, int y) {
-    CellNode * newNode = new CellNode;
-    assert(cell);
-    newNode -> cell = cell;
-    newNode -> type = type;
-    newNode -> x = x;
-    newNode -> y = y;
-    add(newNode, type);
-}
-
-
 /**
  * Go through the CellList by deleting and removing cells that have been killed by lack or nutrients or radiation
  *
@@ -104,14 +97,15 @@ void CellList::deleteDeadAndSort(){
     CellNode ** previous_next_pointer;
     while(current){
         if (!(current -> cell -> alive)){
-            delete current->cell;
-            if (current -> type == 'o')
-                oar_count--;
-            if (current -> type == 'c')
-                ccell_count--;
             CellNode * toDel = current;
             current = current -> next;
-            delete toDel;
+            if (pool){
+                pool -> destroy(toDel -> cell);
+                pool -> release(toDel);
+            } else {
+                delete toDel -> cell;
+                delete toDel;
+            }
             size--;
         } else if (!found_head){
             head = current;
@@ -136,38 +130,12 @@ void CellList::deleteDeadAndSort(){
     }
 }
 /**
- * Compute a weighted sum of the cells in this cell list
+ * Constructor of CycleTile
  *
- * Cancer cells have a weight of -1, healthy cells of 1 and OAR cells have a weight corresponding to the worth assigned
- * to them in the class OARCell
- *
- * @return The weighted sum
+ * @param x1, x2 The first row of the tile and the row following its last one
+ * @param y1, y2 The first column of the tile and the column following its last one
  */
-int CellList::CellTypeSum(){
-    if (size == 0)
-        return 0;
-    if(ccell_count > 0)
-        return -ccell_count;
-    else
-        return size;
-}
-
-
-/**
- * Sets all the OARCells present in this list out of quiescence
- *
- */
-void CellList::wake_oar(){
-    if (oar_count == 0)
-        return;
-    CellNode * current = head;
-    while(current){
-        if (current -> type == 'o')
-            current -> cell -> wake();
-        current = current -> next;
-    }
-}
-
+CycleTile::CycleTile(int x1, int x2, int y1, int y2): x1(x1), x2(x2), y1(y1), y2(y2), ctx(0), has_dead(false) {}
 
 /**
  * Constructor of SourceList
@@ -214,30 +182,25 @@ void SourceList::add(int x, int y) {
 /**
  * Constructor of Grid without an OAR zone
  *
- * The grid is the base of the simulation, it is made out of 3 superimposed 2D layers : one contains the CellLists for
- * each pixel, one contains the glucose amount on each pixel and one contains the oxygen amount on each pixel.
+ * The grid is the base of the simulation, it is made out of 3 superimposed 2D layers : one contains the cells of each
+ * pixel (in a CellStore), one contains the glucose amount on each pixel and one contains the oxygen amount on each pixel.
  *
  * @param xsize The number of rows of the grid
  * @param ysize The number of columns of the grid
  * @param sources_num The number of nutrient sources that should be added to the grid
+ * @param seed The seed of the random streams of the simulation
  */
-Grid::Grid(int xsize, int ysize, int sources_num):xsize(xsize), ysize(ysize), oar(nullptr){
-    cells = new CellList*[xsize];
-    glucose = new double*[xsize];
-    glucose_helper = new double*[xsize]; // glucose_helper and oxygen_helper are useful to speed up diffusion
-    oxygen = new double*[xsize];
-    oxygen_helper = new double*[xsize];
-    neigh_counts = new int*[xsize];
-    for(int i = 0; i < xsize; i++) {
-        cells[i] = new CellList[ysize];
-        glucose[i] = new double[ysize];
-        glucose_helper[i] = new double[ysize];
-        std::fill_n(glucose[i], ysize, 100.0); // 1E-6 mg O'Neil
-        oxygen[i] = new double[ysize];
-        oxygen_helper[i] = new double[ysize];
-        std::fill_n(oxygen[i], ysize, 1000.0); // 1 E-6 ml Jalalimanesh
-        neigh_counts[i] = new int[ysize]();
-    }
+Grid::Grid(int xsize, int ysize, int sources_num, unsigned int seed):xsize(xsize), ysize(ysize), cells(xsize, ysize),
+                                                                    glucose(xsize, ysize), oxygen(xsize, ysize),
+                                                                    neigh_counts(xsize, ysize),
+                                                                    oar(nullptr), ctx(seed), center_x(0.0), center_y(0.0),
+                                                                    radius_version(-1), radius_center_x(0),
+                                                                    radius_center_y(0), radius_cache(0.0), cycle_threads(1), tile_size(8), cycle_pool(nullptr){
+    glucose.fill(100.0); // 1E-6 mg O'Neil
+    oxygen.fill(1000.0); // 1 E-6 ml Jalalimanesh
+    diffusion_lines = new double[diffusion_lines_size(ysize)];
+    dose_field = new double[xsize * ysize]();
+    dose_box = PixelBox{0, 0, 0, 0};
     for(int i = 0; i < xsize; i++){
         neigh_counts[i][0] += 3;
         neigh_counts[i][ysize - 1] += 3;
@@ -250,9 +213,10 @@ Grid::Grid(int xsize, int ysize, int sources_num):xsize(xsize), ysize(ysize), oa
     neigh_counts[0][ysize -1] -= 1;
     neigh_counts[xsize - 1][0] -= 1;
     neigh_counts[xsize - 1][ysize - 1] -= 1;
+    cells.stats = &ctx.stats;
     sources = new SourceList();
     for (int i = 0; i < sources_num; i++){
-        sources->add(rand() % xsize, rand() % ysize); // Set the sources at random locations on the grid
+        sources->add(ctx.rand_int() % xsize, ctx.rand_int() % ysize); // Set the sources at random locations on the grid
     }
 }
 
@@ -260,8 +224,8 @@ Grid::Grid(int xsize, int ysize, int sources_num):xsize(xsize), ysize(ysize), oa
 /**
  * Constructor of Grid with an OAR zone
  *
- * The grid is the base of the simulation, it is made out of 3 superimposed 2D layers : one contains the CellLists for
- * each pixel, one contains the glucose amount on each pixel and one contains the oxygen amount on each pixel.
+ * The grid is the base of the simulation, it is made out of 3 superimposed 2D layers : one contains the cells of each
+ * pixel (in a CellStore), one contains the glucose amount on each pixel and one contains the oxygen amount on each pixel.
  * The OAR zone is represented by 2 coordinates that thus form a rectangle on the Grid. Every pixel in that rectangle
  * will contain an OARCell
  *
@@ -269,78 +233,85 @@ Grid::Grid(int xsize, int ysize, int sources_num):xsize(xsize), ysize(ysize), oa
  * @param ysize The number of columns of the grid
  * @param sources_num The number of nutrient sources that should be added to the grid
  * @param oar_zone The OARZone object that contains the rectangle's coordinates
+ * @param seed The seed of the random streams of the simulation
  */
-Grid::Grid(int xsize, int ysize, int sources_num, OARZone * oar_zone):Grid(xsize, ysize, sources_num){
+Grid::Grid(int xsize, int ysize, int sources_num, OARZone * oar_zone, unsigned int seed):Grid(xsize, ysize, sources_num, seed){
     oar = oar_zone;
 }
 
+/**
+ * Copy constructor of Grid
+ *
+ * Makes a deep copy of the cells, nutrients, sources and random streams of other, so that the copy evolves exactly like
+ * other would. The copy uses the same OARZone as other (the Grid does not own it), see set_oar_zone, and as many
+ * threads as other in cycle_cells. The statistics of the copy (see SimStats) start from zero.
+ *
+ * @param other The grid to copy
+ */
+Grid::Grid(const Grid & other):xsize(other.xsize), ysize(other.ysize), cells(other.cells), glucose(other.glucose),
+                               oxygen(other.oxygen), neigh_counts(other.neigh_counts),
+                               dose_profile(other.dose_profile), oar(other.oar),
+                               ctx(other.ctx), center_x(other.center_x), center_y(other.center_y),
+                               radius_version(other.radius_version), radius_center_x(other.radius_center_x),
+                               radius_center_y(other.radius_center_y), radius_cache(other.radius_cache), cycle_threads(1), tile_size(other.tile_size), cycle_pool(nullptr){
+    diffusion_lines = new double[diffusion_lines_size(ysize)];
+    dose_field = new double[xsize * ysize];
+    std::copy_n(other.dose_field, xsize * ysize, dose_field);
+    dose_box = other.dose_box;
+    ctx.stats.reset();
+    cells.stats = &ctx.stats;
+    sources = new SourceList();
+    for (Source * current = other.sources -> head; current; current = current -> next)
+        sources -> add(current -> x, current -> y);
+    set_cycle_threads(other.cycle_threads, other.tile_size);
+}
+
 /**
  * Destructor of Grid
  *
  */
 Grid::~Grid() {
-    for (int i = 0; i < xsize; i++){
-        delete[] cells[i];
-        delete[] glucose[i];
-        delete[] oxygen[i];
-        delete[] glucose_helper[i];
-        delete[] oxygen_helper[i];
-        delete[] neigh_counts[i];
-    }
-    delete[] cells;
-    delete[] glucose;
-    delete[] oxygen;
+    delete[] diffusion_lines;
+    delete[] dose_field;
     delete sources;
-    delete[] oxygen_helper;
-    delete[] glucose_helper;
-    delete[] neigh_counts;
+    delete cycle_pool;
 }
 
 /**
  * Add val to the current "neighbor count" of the pixel at coordinates (x, y) on the grid
  *
  * Neighbor counts are the number of cells on neighbouring pixels, for each pixel. They are useful to check if Healthy
- * Cells need to stay in or enter quiescence, which happens once a certain density has been reached.
+ * Cells need to stay in or enter quiescence, which happens once a certain density has been reached. The neighbours
+ * outside of the grid fall in the halo of neigh_counts, so they need no special case.
  *
  * @param x The x coordinate of the pixel
  * @param y The y coordinate of the pixel
  * @param val The amount that we add to the neighbor count
  */
 void Grid::change_neigh_counts(int x, int y, int val) {
-    bool up = (x > 0);
-    bool down = (x < xsize-1);
-    bool left = (y > 0);
-    bool right = (y < ysize -1);
-    if (up){
-        neigh_counts[x-1][y] += val;
-        if (left)
-            neigh_counts[x-1][y-1] += val;
-        if (right)
-            neigh_counts[x-1][y+1] += val;
-    }
-    if (down){
-        neigh_counts[x+1][y] += val;
-        if (left)
-            neigh_counts[x+1][y-1] += val;
-        if (right)
-            neigh_counts[x+1][y+1] += val;
-    }
-    if (left)
-        neigh_counts[x][y-1] += val;
-    if (right)
-        neigh_counts[x][y+1] += val;
+    int * above = neigh_counts[x - 1] + y;
+    int * row = neigh_counts[x] + y;
+    int * below = neigh_counts[x + 1] + y;
+    above[-1] += val;
+    above[0] += val;
+    above[1] += val;
+    row[-1] += val;
+    row[1] += val;
+    below[-1] += val;
+    below[0] += val;
+    below[1] += val;
 }
 
 /**
- * Add a cell to a position on the grid
+ * Create a new cell at a position on the grid
  *
  * @param x The x coordinate where we want to add the cell
  * @param y The y coordinate where we want to add the cell
- * @param ysize The number of columns of the grid
- * @param sources_num The number of nutrient sources that should be added to the grid
+ * @param type The type of the cell ('h' for healthy, 'c' for cancer, 'o' for OAR)
+ * @param stage The stage of the cell in the cell cycle
  */
-void Grid::addCell(int x, int y, Cell *cell, char type) {
-    cells[x][y].add(cell, type,x, y);
+void Grid::addCell(int x, int y, char type, char stage) {
+    cells.add(x * ysize + y, type, stage, &ctx);
     change_neigh_counts(x, y, 1);
 }
 
@@ -353,11 +324,12 @@ void Grid::addCell(int x, int y, Cell *cell, char type) {
  * @param oxy The oxygen amount that we add to the pixel corresponding to each source
  */
 void Grid::fill_sources(double glu, double oxy) {
+    PhaseTimer timer(ctx.stats, FILL_SOURCES_PHASE);
     Source * current = sources -> head;
     while(current){ // We go through all sources
         glucose[current->x][current->y] += glu;
         oxygen[current->x][current->y] += oxy;
-        if ((rand() % 24) < 1){ // The source moves on average once a day
+        if ((ctx.rand_int() % 24) < 1){ // The source moves on average once a day
             int newPos = sourceMove(current->x, current->y);
             current -> x = newPos / ysize;
             current -> y = newPos % ysize;
@@ -374,7 +346,7 @@ void Grid::fill_sources(double glu, double oxy) {
  * @return An integer corresponding to the new position (ysize * x + y)
  */
 int Grid::sourceMove(int x, int y){
-    if (rand() % 50000 < CancerCell::count){ // Move towards tumour center
+    if (ctx.rand_int() % 50000 < ctx.ccell_count){ // Move towards tumour center
         if (x < center_x)
             x++;
         else if (x > center_x)
@@ -385,7 +357,7 @@ int Grid::sourceMove(int x, int y){
             y--; 
         return x * ysize + y;
     } else{ // Move in random direction
-        return rand_adj(x, y);
+        return rand_adj(x, y, &ctx);
     }
 }
 
@@ -393,65 +365,275 @@ int Grid::sourceMove(int x, int y){
 /**
  * Go through all cells on the grid and advance them by one hour in their cycle
  *
+ * The cells created during the hour are only added to their pixel once all the pixels have been processed. With more
+ * than one thread (see set_cycle_threads), the pixels are processed by tiles instead of row by row, see cycle_tiles.
  */
-void Grid::cycle_cells() { 
-    CellList * toAdd = new CellList();
-    for (int x = 0; x < xsize * ysize; x++){
-        int i = x / ysize; // Coordinates of the pixel
-        int j = x % ysize;
-        CellNode * current = cells[i][j].head;
-        while(current){ // Go through all cells on this pixel
-            cell_cycle_res result = current->cell->cycle(glucose[i][j], oxygen[i][j], neigh_counts[i][j] + cells[i][j].size);
-            glucose[i][j] -= result.glucose;
-            oxygen[i][j] -= result.oxygen;
-            if (result.new_cell == 'h'){ //New healthy cell
-                int downhill = rand_min(i, j, 5);
-                if(downhill >= 0)
-                    toAdd -> add(new HealthyCell('q'), 'h', downhill / ysize, downhill % ysize);
-                else
-                    current -> cell -> sleep();
-            }
-            if (result.new_cell == 'c'){ // New cancer cell
-                int downhill = rand_adj(i, j);
-                if(downhill >= 0)
-                    toAdd -> add(new CancerCell('1'), 'c', downhill / ysize, downhill % ysize);
-            }
-            if (result.new_cell == 'o'){ // New oar cell
-                int downhill = find_missing_oar(i, j);
-                if (downhill >= 0){
-                    toAdd -> add(new OARCell('1'), 'o', downhill / ysize, downhill % ysize);
-                } else{
-                    current -> cell -> sleep();
-                }
+void Grid::cycle_cells() {
+    PhaseTimer timer(ctx.stats, CYCLE_CELLS_PHASE);
+    cells.commit();
+    ctx.next_epoch();
+    if (cycle_threads > 1){
+        cycle_tiles();
+        return;
+    }
+    bool has_dead = false;
+    for (int x = 0; x < xsize * ysize; x++)
+        has_dead |= cycle_pixel(x, &ctx, born);
+    ctx.select_main();
+    if (has_dead)
+        cells.mark_dead();
+    cells.add_all(born);
+    born.clear();
+    cells.commit(); //Add all new cells to the grid
+}
+
+/**
+ * The kernels of the cells of type TYPE ('h', 'c' or 'o') applied to cell k of a CellColumns, resolved at compile time
+ *
+ * The efficiency draw is only used by cancer cells, see CancerCell::cycle_kernel. Radiation takes the survival
+ * probabilities of the cells of the pixel and two draws from [0, 1) for each cell.
+ */
+template <char TYPE> struct CellTypeKernels;
+
+static const int efficiency_batch = 64; // Number of efficiency draws made at once by cycle_run
+static const int radiation_batch = 64; // Number of cells whose radiation draws are made at once by radiate_run
+
+template <> struct CellTypeKernels<'h'> {
+    typedef HealthyCell cell_type;
+    static cell_cycle_res cycle(CellColumns & cells, int k, double efficiency_draw, double glucose, double oxygen,
+                                int neigh_count, SimContext * c){
+        return HealthyCell::cycle_kernel(cells.stage[k], cells.age[k], cells.repair[k], cells.glu_efficiency[k],
+                                         cells.oxy_efficiency[k], glucose, oxygen, neigh_count, c);
+    }
+    static void radiate(CellColumns & cells, int k, SurvivalTable<HealthyCell> & survival, const double * draws,
+                        SimContext * c){
+        HealthyCell::radiate_kernel(cells.stage[k], cells.repair[k], survival.at(cells.stage[k]), survival.dose(),
+                                    draws, c);
+    }
+};
+
+template <> struct CellTypeKernels<'c'> {
+    typedef CancerCell cell_type;
+    static cell_cycle_res cycle(CellColumns & cells, int k, double efficiency_draw, double glucose, double oxygen,
+                                int neigh_count, SimContext * c){
+        return CancerCell::cycle_kernel(cells.stage[k], cells.age[k], cells.repair[k], efficiency_draw, glucose, oxygen,
+                                        neigh_count, c);
+    }
+    static void radiate(CellColumns & cells, int k, SurvivalTable<CancerCell> & survival, const double * draws,
+                        SimContext * c){
+        CancerCell::radiate_kernel(cells.stage[k], cells.repair[k], survival.at(cells.stage[k]), survival.dose(),
+                                   draws, c);
+    }
+};
+
+template <> struct CellTypeKernels<'o'> {
+    typedef OARCell cell_type;
+    static cell_cycle_res cycle(CellColumns & cells, int k, double efficiency_draw, double glucose, double oxygen,
+                                int neigh_count, SimContext * c){
+        return OARCell::cycle_kernel(cells.stage[k], cells.age[k], cells.glu_efficiency[k], cells.oxy_efficiency[k],
+                                     glucose, oxygen, neigh_count, c);
+    }
+    static void radiate(CellColumns & cells, int k, SurvivalTable<OARCell> & survival, const double * draws,
+                        SimContext * c){
+        OARCell::radiate_kernel(cells.stage[k], survival.at(cells.stage[k]), draws, c);
+    }
+};
+
+/**
+ * Irradiate the cells [first, last) of a pixel, which are all of type TYPE
+ *
+ * The survival probabilities are shared by all the cells of the pixel, and the draws of the cells are made in batches
+ * (see SimContext::fill_uniform).
+ *
+ * @param pixel The pixel of the cells
+ * @param survival Survival probabilities of the cells to the dose received by the pixel
+ * @param c The context in which cells are counted and random numbers are drawn
+ * @return Whether some of these cells died
+ */
+template <char TYPE>
+static bool radiate_run(CellStore & cells, int first, int last, int pixel,
+                        SurvivalTable<typename CellTypeKernels<TYPE>::cell_type> & survival, SimContext * c){
+    bool dead = false;
+    int begin = cells.begin(pixel);
+    double draws[2 * radiation_batch];
+    for (int k = first; k < last; k++){
+        int n = (k - first) % radiation_batch;
+        if (n == 0)
+            c -> fill_uniform(draws, std::min(radiation_batch, last - k), pixel, k - begin);
+        CellTypeKernels<TYPE>::radiate(cells, k, survival, draws + 2 * n, c);
+        dead |= (cells.stage[k] == 'd');
+    }
+    return dead;
+}
+
+/**
+ * Advance by one hour in their cycle the cells [first, last) of pixel (i, j), which are all of type TYPE
+ *
+ * Each cell draws from its own stream (see SimContext::select), and cancer cells get their efficiency draws in batches.
+ *
+ * @param neigh_count Number of cells on the pixel and its neighbours
+ * @param c The context in which cells are counted and random numbers are drawn
+ * @param born The columns to which the cells created are appended
+ */
+template <char TYPE>
+void Grid::cycle_run(int first, int last, int i, int j, int neigh_count, SimContext * c, CellColumns & born){
+    int x = i * ysize + j;
+    int begin = cells.begin(x);
+    double draws[efficiency_batch]; // Efficiency draws of the next cancer cells
+    SIM_STAT(c -> stats.cells_cycled += last - first);
+    for (int k = first; k < last; k++){
+        if (TYPE == 'c' && (k - first) % efficiency_batch == 0)
+            c -> fill_norm(draws, std::min(efficiency_batch, last - k), x, k - begin);
+        c -> select(x, k - begin);
+        double efficiency_draw = (TYPE == 'c') ? draws[(k - first) % efficiency_batch] : 0.0;
+        cell_cycle_res result = CellTypeKernels<TYPE>::cycle(cells, k, efficiency_draw, glucose[i][j], oxygen[i][j],
+                                                             neigh_count, c);
+        glucose[i][j] -= result.glucose;
+        oxygen[i][j] -= result.oxygen;
+        if (TYPE == 'h' && result.new_cell == 'h'){ //New healthy cell
+            int downhill = rand_min(i, j, 5, c);
+            if(downhill >= 0){
+                CellStore::create(born, downhill, 'h', 'q', c);
+                SIM_STAT(c -> stats.mitoses++);
+            } else
+                Cell::sleep(cells.stage[k], cells.age[k]);
+        }
+        if (TYPE == 'c' && result.new_cell == 'c'){ // New cancer cell
+            int downhill = rand_adj(i, j, c);
+            if(downhill >= 0){
+                CellStore::create(born, downhill, 'c', '1', c);
+                SIM_STAT(c -> stats.mitoses++);
             }
-            if (result.new_cell == 'w'){ // The current cell died because of a lack of nutrients
-               wake_surrounding_oar(i, j);
+        }
+        if (TYPE == 'o' && result.new_cell == 'o'){ // New oar cell
+            int downhill = find_missing_oar(i, j, c);
+            if (downhill >= 0){
+                CellStore::create(born, downhill, 'o', '1', c);
+                SIM_STAT(c -> stats.mitoses++);
+            } else{
+                Cell::sleep(cells.stage[k], cells.age[k]);
             }
-            current = current -> next;
         }
-        int init_count = cells[i][j].size; // Number of cells before we check how many died
-        cells[i][j].deleteDeadAndSort();
-        change_neigh_counts(i, j, cells[i][j].size - init_count);
+        if (TYPE == 'o' && result.new_cell == 'w'){ // The current cell died because of a lack of nutrients
+           wake_surrounding_oar(i, j);
+        }
     }
-    addToGrid(toAdd); //Add all new cells to the grid
 }
 
 /**
- * Add all the cells in newCells to their pixel's CellList
+ * Advance all the cells of a pixel by one hour in their cycle
  *
- * @param newCells The CellList of new cells that we want to add to the grid
+ * Only the pixel and its 8 neighbours are read or written, which is what allows distant pixels to be processed in
+ * parallel. The cells are processed in their order in the CellStore, by runs of cells of the same type so that the
+ * kernel of each type is dispatched once per run rather than once per cell.
+ *
+ * @param x The pixel (x * ysize + y)
+ * @param c The context in which cells are counted and random numbers are drawn
+ * @param born The columns to which the cells created are appended
+ * @return Whether some cells of the pixel died
  */
-void Grid::addToGrid(CellList * newCells){
-    CellNode * current = newCells -> head;
-    while(current){
-        CellNode * next = current -> next;
-        cells[current -> x][current -> y].add(current, current -> type);
-        current = next;
+bool Grid::cycle_pixel(int x, SimContext * c, CellColumns & born){
+    int i = x / ysize; // Coordinates of the pixel
+    int j = x % ysize;
+    int neigh_count = neigh_counts[i][j] + cells.size[x];
+    int end = cells.end(x);
+    for (int first = cells.begin(x), last; first < end; first = last){ // Go through all cells on this pixel
+        char type = cells.type[first];
+        for (last = first + 1; last < end && cells.type[last] == type; last++);
+        switch (type){
+            case 'h':
+                cycle_run<'h'>(first, last, i, j, neigh_count, c, born);
+                break;
+            case 'c':
+                cycle_run<'c'>(first, last, i, j, neigh_count, c, born);
+                break;
+            default:
+                cycle_run<'o'>(first, last, i, j, neigh_count, c, born);
+        }
     }
-    newCells -> head = nullptr;
-    newCells -> tail = nullptr;
-    newCells -> size = 0;
-    delete newCells;
+    int init_count = cells.size[x]; // Number of cells before we check how many died
+    bool has_dead = cells.recount(x);
+    change_neigh_counts(i, j, cells.size[x] - init_count);
+    SIM_STAT(c -> stats.starvation_deaths += init_count - cells.size[x]);
+    return has_dead;
+}
+
+/**
+ * Multithreaded version of cycle_cells
+ *
+ * The grid is cut in square tiles, coloured like a 2x2 checkerboard of checkerboards: two tiles of the same colour are
+ * at least one tile apart, so the 3x3 neighbourhoods touched by their pixels never overlap and they can be processed at
+ * the same time. The four colours are processed one after the other, each tile by a single thread, in row order.
+ *
+ * Each tile has its own context, whose cells draw from the same streams as in the serial version (see
+ * SimContext::select), and keeps its new cells and changes of the population counters aside until all tiles are done,
+ * when they are merged in tile order. The result thus depends on the tile size, which sets the order in which pixels
+ * are processed, but not on the number of threads or on their scheduling.
+ */
+void Grid::cycle_tiles() {
+    for (int colour = 0; colour < 4; colour++){
+        int first = colour_offsets[colour];
+        cycle_pool -> run(colour_offsets[colour + 1] - first, [this, first](int n){
+            CycleTile & tile = tiles[first + n];
+            tile.ctx.share_streams(ctx);
+            tile.ctx.reset_counts();
+            tile.ctx.stats.reset();
+            tile.has_dead = false;
+            for (int i = tile.x1; i < tile.x2; i++){
+                for (int j = tile.y1; j < tile.y2; j++)
+                    tile.has_dead |= cycle_pixel(i * ysize + j, &tile.ctx, tile.born);
+            }
+        });
+    }
+    for (CycleTile & tile : tiles){
+        ctx.hcell_count += tile.ctx.hcell_count;
+        ctx.ccell_count += tile.ctx.ccell_count;
+        ctx.oar_count += tile.ctx.oar_count;
+        ctx.stats.add_events(tile.ctx.stats);
+        if (tile.has_dead)
+            cells.mark_dead();
+        cells.add_all(tile.born);
+        tile.born.clear();
+    }
+    cells.commit(); //Add all new cells to the grid
+}
+
+/**
+ * Choose how many threads cycle_cells uses
+ *
+ * With a single thread, pixels are processed row by row as they always have been. With more, they are processed by
+ * tiles (see cycle_tiles): the simulation is still reproducible for a given seed and tile size, whatever the number of
+ * threads, but it differs from the single-threaded one.
+ *
+ * @param num_threads The number of threads, 1 or less for the single-threaded cycle
+ * @param tile_size The side of the tiles in pixels, at least 2
+ */
+void Grid::set_cycle_threads(int num_threads, int tile_size){
+    delete cycle_pool;
+    cycle_pool = nullptr;
+    tiles.clear();
+    cycle_threads = std::max(num_threads, 1);
+    this -> tile_size = std::max(tile_size, 2);
+    if (cycle_threads == 1)
+        return;
+    cycle_pool = new ThreadPool(cycle_threads);
+    int size = this -> tile_size;
+    for (int colour = 0; colour < 4; colour++){
+        colour_offsets[colour] = (int) tiles.size();
+        for (int tx = colour / 2; tx * size < xsize; tx += 2){
+            for (int ty = colour % 2; ty * size < ysize; ty += 2)
+                tiles.push_back(CycleTile(tx * size, std::min((tx + 1) * size, xsize),
+                                          ty * size, std::min((ty + 1) * size, ysize)));
+        }
+    }
+    colour_offsets[4] = (int) tiles.size();
+}
+
+/**
+ * Return the number of threads used by cycle_cells
+ */
+int Grid::get_cycle_threads(){
+    return cycle_threads;
 }
 
 /**
@@ -461,7 +643,7 @@ void Grid::addToGrid(CellList * newCells){
  * @param y The y of the pixel around which we are searching
  * @return An integer corresponding to the pixel coordinates found (ysize * x + y)
  */
-int Grid::rand_min(int x, int y, int max){
+int Grid::rand_min(int x, int y, int max, SimContext * c){
     int counter = 0;
     int curr_min = 100000;
     int pos[8];
@@ -476,7 +658,7 @@ int Grid::rand_min(int x, int y, int max){
     min_helper(x+1, y+1, curr_min, pos, counter);
 
     if (curr_min < max)
-        return pos[rand() % counter];
+        return pos[c -> rand_int() % counter];
     else
         return -1;
 }
@@ -491,11 +673,12 @@ void Grid::min_helper(int x, int y, int&  curr_min, int * pos, int& counter){
     if (oar && x >= oar->x1 && x < oar->x2 && y >= oar -> y1 && y < oar -> y2)
         return;
     if (x >= 0 && x < xsize && y >= 0 && y < ysize){
-        if (cells[x][y].size < curr_min){
+        int size = cells.size[x*ysize+y];
+        if (size < curr_min){
             pos[0] = x*ysize+y;
             counter = 1;
-            curr_min = cells[x][y].size;
-        } else if(cells[x][y].size == curr_min){
+            curr_min = size;
+        } else if(size == curr_min){
             pos[counter] = x*ysize+y;
             counter++;
         }
@@ -510,7 +693,7 @@ void Grid::min_helper(int x, int y, int&  curr_min, int * pos, int& counter){
  * @param y The y of the pixel around which we are searching
  * @return An integer corresponding to the pixel coordinates found (ysize * x + y)
  */
-int Grid::rand_adj(int x,  int y){
+int Grid::rand_adj(int x,  int y, SimContext * c){
     int counter = 0;
     int pos[8];
 
@@ -523,7 +706,7 @@ int Grid::rand_adj(int x,  int y){
     adj_helper(x+1, y, pos, counter);
     adj_helper(x+1, y+1,  pos, counter);
 
-    return pos[rand() % counter];
+    return pos[c -> rand_int() % counter];
 }
 
 
@@ -545,7 +728,7 @@ void Grid::adj_helper(int x, int y, int * pos, int& counter){
  * @param y The y of the pixel around which we are searching
  * @return An integer corresponding to the pixel coordinates found (ysize * x + y)
  */
-int Grid::find_missing_oar(int x, int y){
+int Grid::find_missing_oar(int x, int y, SimContext * c){
     int counter = 0;
     int curr_min = 100000;
     int pos[8];
@@ -559,7 +742,7 @@ int Grid::find_missing_oar(int x, int y){
     missing_oar_helper(x+1, y, curr_min, pos, counter);
     missing_oar_helper(x+1, y+1, curr_min, pos, counter);
 
-    return (counter > 0)? pos[rand() % counter] : -1;
+    return (counter > 0)? pos[c -> rand_int() % counter] : -1;
 }
 
 /**
@@ -569,12 +752,13 @@ int Grid::find_missing_oar(int x, int y){
  * doesn't contain an OARCell.
  */
 void Grid::missing_oar_helper(int x, int y, int&  curr_min, int * pos, int& counter){
-    if (oar && x >= oar->x1 && x < oar->x2 && y >= oar -> y1 && y < oar -> y2  && cells[x][y].oar_count == 0){
-        if (cells[x][y].size < curr_min){
+    if (oar && x >= oar->x1 && x < oar->x2 && y >= oar -> y1 && y < oar -> y2  && cells.oar_count[x*ysize+y] == 0){
+        int size = cells.size[x*ysize+y];
+        if (size < curr_min){
             pos[0] = x*ysize+y;
             counter = 1;
-            curr_min = cells[x][y].size;
-        } else if(cells[x][y].size == curr_min){
+            curr_min = size;
+        } else if(size == curr_min){
             pos[counter] = x*ysize+y;
             counter++;
         }
@@ -606,58 +790,7 @@ void Grid::wake_surrounding_oar(int x, int y){
  */
 void Grid::wake_helper(int x, int y){
     if (oar && x >= oar->x1 && x < oar-> x2 && y >= oar->y1 && y < oar -> y2)
-        cells[x][y].wake_oar();
-}
-
-
-/**
- * Helper for diffuse
- *
- * Spreads the float amount of each entry in a 2D array to the neighbouring entries with a factor of diff_factor
- *
- * @param src The 2D array with the initial amounts
- * @param dest The 2D array in which the diffusion will have occurred
- * @param xsize The number of rows of the arrays
- * @param ysize The number of columns of the arrays
- * @param diff_factor The share of each entry's float amount that should be spread to neighbouring pixels
- */
-void diffuse_helper(double** src, double** dest, int xsize, int ysize, double diff_factor){
-    for (int i = 0; i < xsize; i++){
-        for (int j = 0; j < ysize; j++)
-            dest[i][j] = (1.0- diff_factor) * src[i][j]; //initial
-        for (int j = 1; j < ysize; j++)
-            dest[i][j] += 0.125 * diff_factor * src[i][j-1]; // shift right
-        for (int j = 0 ;  j< ysize-1; j++)
-            dest[i][j] += 0.125 * diff_factor *src[i][j+1]; // shift left
-    }
-    for (int i = 1; i < xsize; i++){
-        for (int j = 0; j < ysize; j++)
-            dest[i][j] += 0.125 * diff_factor * src[i-1][j]; // shift down
-    }
-    for (int i = 0; i < ysize-1 ; i++){
-        for (int j = 0; j < ysize ; j++)
-            dest[i][j] += 0.125 * diff_factor * src[i+1][j]; // shift up
-    }
-    for (int i = 0; i < xsize -1; i++){
-        for(int j = 0; j < ysize-1; j++){
-            dest[i][j] += 0.125 * diff_factor * src[i+1][j+1]; // up left
-        }
-    }
-    for (int i = 1; i < xsize; i++){
-        for(int j = 1; j < ysize; j++){
-            dest[i][j] += 0.125 * diff_factor * src[i-1][j-1]; // down right
-        }
-    }
-    for (int i = 0; i < xsize - 1; i++){
-        for(int j = 1; j < ysize; j++){
-            dest[i][j] += 0.125 * diff_factor * src[i+1][j-1]; // up right
-        }
-    }
-    for (int i = 1; i < xsize; i++){
-        for(int j = 0; j < ysize -1; j++){
-            dest[i][j] += 0.125 * diff_factor * src[i-1][j+1]; // down left
-        }
-    }
+        cells.wake_oar(x*ysize+y);
 }
 
 
@@ -667,51 +800,8 @@ void diffuse_helper(double** src, double** dest, int xsize, int ysize, double di
  * @param diff_factor The share of each pixel's glucose and oxygen that should be spread to neighbouring pixels
  */
 void Grid::diffuse(double diff_factor) {
-    diffuse_helper(glucose, glucose_helper, xsize, ysize, diff_factor);
-    double ** temp = glucose;
-    glucose = glucose_helper;
-    glucose_helper = temp;
-    diffuse_helper(oxygen, oxygen_helper, xsize, ysize, diff_factor);
-    temp = oxygen;
-    oxygen = oxygen_helper;
-    oxygen_helper = temp;
-}
-
-
-/**
- * Computes the Euclidean distance between two points
- *
- * @param x1, y1 Coordinates of the first point
- * @param x2, y2 Coordinates of the second point
- * @return The Euclidean distance between the two points
- */
-double distance(int x1, int y1, double x2, double y2){
-    int dist_x = x1 - x2;
-    int dist_y = y1 - y2;
-    return sqrt(dist_x * dist_x + dist_y * dist_y);
-}
-
-
-/**
- * Computes the dose depending on the distance to the tumor's center
- *
- * @param rad Radius of the radiation (95 % of the full dose at 1 radius from the center)
- * @param x Distance from the center
- * @return The Euclidean distance between the two points
- */
-double conv(double rad, double x){
-    double denom = 3.8;//sqrt(2) * 2.7
-    return erf((rad - x)/denom) - erf((-rad - x) / denom);
-}
-
-
-
-double get_multiplicator(double dose, double radius){
-    return dose / conv(14, 0);
-}
-
-double scale(double radius, double x, double multiplicator){
-    return multiplicator * conv(14.0, x * 10.0 / radius);
+    PhaseTimer timer(ctx.stats, DIFFUSE_PHASE);
+    diffuse_fields(glucose.data(), oxygen.data(), xsize, ysize, glucose.stride(), diff_factor, diffusion_lines);
 }
 
 
@@ -724,33 +814,72 @@ double scale(double radius, double x, double multiplicator){
  * @param center_y The y coordinate of the center of radiation
  */
 void Grid::irradiate(double dose, double radius, double center_x, double center_y){
-    if (dose == 0) // A dose of 0 is sometimes sent here to signify that the agent has chosen not to irradiate,
+    PhaseTimer timer(ctx.stats, IRRADIATE_PHASE);
+    for (int i = dose_box.x1; i < dose_box.x2; i++) // Only the pixels irradiated last time have a dose to clear
+        std::fill(dose_field + i * ysize + dose_box.y1, dose_field + i * ysize + dose_box.y2, 0.0);
+    dose_box = PixelBox{0, 0, 0, 0};
+    if (dose == 0 || !std::isfinite(center_x) || !std::isfinite(center_y)) // A dose of 0 is sometimes sent here to signify that the agent has chosen not to irradiate,
         return;
     double multiplicator = get_multiplicator(dose, radius); // Ensures that we have a max amplitude of dose
     double oer_m = 3.0;
     double k_m = 3.0;
-    for (int i = 0; i < xsize; i++){
-        for (int j = 0; j < ysize; j++){
-            double dist = distance(i, j, center_x, center_y); //Distance of the pixel from the center
-            if (cells[i][j].size && dist < 3 * radius){ //If there are cells on the pixel
-                CellNode * current = cells[i][j].head;
+    cells.commit();
+    // Offsets from the center are truncated to whole pixels, so the largest ones are found at the edges of the grid
+    int max_x = std::max(std::abs((int) (0 - center_x)), std::abs((int) (xsize - 1 - center_x)));
+    int max_y = std::max(std::abs((int) (0 - center_y)), std::abs((int) (ysize - 1 - center_y)));
+    dose_profile.set_radius(radius, max_x * max_x + max_y * max_y);
+    int reach = dose_profile.reach();
+    if (reach < 0)
+        return;
+    // A truncated offset of at most reach means a real offset strictly below reach + 1
+    dose_box.x1 = (int) std::max(0.0, floor(center_x) - reach);
+    dose_box.x2 = (int) std::min((double) xsize, ceil(center_x) + reach + 1);
+    dose_box.y1 = (int) std::max(0.0, floor(center_y) - reach);
+    dose_box.y2 = (int) std::min((double) ysize, ceil(center_y) + reach + 1);
+    ctx.next_epoch();
+    for (int i = dose_box.x1; i < dose_box.x2; i++){
+        for (int j = dose_box.y1; j < dose_box.y2; j++){
+            int x = i * ysize + j;
+            int dist_x = i - center_x;
+            int dist_y = j - center_y;
+            int squared_dist = dist_x * dist_x + dist_y * dist_y; // Squared distance of the pixel from the center
+            if (!dose_profile.reaches(squared_dist)){
+                dose_field[x] = 0.0;
+                continue;
+            }
+            dose_field[x] = multiplicator * dose_profile.at(squared_dist);
+            if (cells.size[x]){ //If there are cells on the pixel
                 bool oar_dead = false;
-                while (current){
-                    double omf = (oxygen[i][j] / 100.0 * oer_m + k_m) / (oxygen[i][j] / 100.0 + k_m) / oer_m; // Include the effect of hypoxia, Powathil formula
-                    current -> cell -> radiate(scale(radius, dist, multiplicator) * omf);
-                    if (!(current -> cell ->alive) && current->type == 'o'){
-                        oar_dead = true;
+                double omf = (oxygen[i][j] / 100.0 * oer_m + k_m) / (oxygen[i][j] / 100.0 + k_m) / oer_m; // Include the effect of hypoxia, Powathil formula
+                double cell_dose = dose_field[x] * omf;
+                SurvivalTable<HealthyCell> healthy_survival(cell_dose);
+                SurvivalTable<CancerCell> cancer_survival(cell_dose);
+                SurvivalTable<OARCell> oar_survival(cell_dose);
+                int end = cells.end(x);
+                for (int first = cells.begin(x), last; first < end; first = last){ // Runs of cells of the same type
+                    char type = cells.type[first];
+                    for (last = first + 1; last < end && cells.type[last] == type; last++);
+                    switch (type){
+                        case 'h':
+                            radiate_run<'h'>(cells, first, last, x, healthy_survival, &ctx);
+                            break;
+                        case 'c':
+                            radiate_run<'c'>(cells, first, last, x, cancer_survival, &ctx);
+                            break;
+                        default:
+                            oar_dead |= radiate_run<'o'>(cells, first, last, x, oar_survival, &ctx);
                     }
-                    current = current -> next;
                 }
                 if(oar_dead) // If an oarcell was killed we pull neighbouring cells out of quiescence to replace it
                     wake_surrounding_oar(i, j);
-                int init_count = cells[i][j].size;
-                cells[i][j].deleteDeadAndSort();
-                change_neigh_counts(i, j, cells[i][j].size - init_count);
+                int init_count = cells.size[x];
+                cells.update_counts(x);
+                change_neigh_counts(i, j, cells.size[x] - init_count);
+                SIM_STAT(ctx.stats.radiation_deaths += init_count - cells.size[x]);
             }
         }
     }
+    cells.commit();
 }
 
 /**
@@ -761,13 +890,17 @@ void Grid::irradiate(double dose, double radius, double center_x, double center_
  * @return The distance from the cell furthest away from the center to the center
  */
 double Grid::tumor_radius(int center_x, int center_y){
-    if (CancerCell::count == 0){
+    if (ctx.ccell_count == 0){
         return -1.0;
     }
+    cells.commit();
+    if (radius_version == cells.version && radius_center_x == center_x && radius_center_y == center_y)
+        return radius_cache; // The cells have not changed since the last call with the same center
     double dist = -1.0;
-    for (int i = 0; i < xsize; i++){
-        for (int j = 0; j < ysize; j++){
-            if (cells[i][j].size > 0 && cells[i][j].head -> type == 'c'){
+    PixelBox box = cells.cancer_box;
+    for (int i = box.x1; i < box.x2; i++){
+        for (int j = box.y1; j < box.y2; j++){
+            if (cells.ccell_count[i * ysize + j] > 0){
                 int dist_x = i - center_x;
                 int dist_y = j - center_y;
                 dist = std::max(dist, (double) sqrt(dist_x * dist_x + dist_y * dist_y));
@@ -776,14 +909,24 @@ double Grid::tumor_radius(int center_x, int center_y){
     }
     if (dist < 3.0)
         dist = 3.0;
+    radius_version = cells.version;
+    radius_center_x = center_x;
+    radius_center_y = center_y;
+    radius_cache = dist;
     return dist;
 }
 
 /**
- * Compute the weighted sum of cell types for the CellList on position x, y
+ * Compute a weighted sum of the cells on position x, y
+ *
+ * @return 0 if there are no cells, minus the number of cancer cells if there are some, and the number of cells otherwise
  */
 int Grid::pixel_density(int x, int y){
-    return cells[x][y].CellTypeSum();
+    cells.commit();
+    int pixel = x * ysize + y;
+    if (cells.ccell_count[pixel] > 0)
+        return -cells.ccell_count[pixel];
+    return cells.size[pixel];
 }
 
 /**
@@ -792,8 +935,10 @@ int Grid::pixel_density(int x, int y){
  * @return 0 if there are no cells on this position, -1 if there is a cancer cell, 1 for a healthy cell and 2 for an OAR cell
  */
 int Grid::pixel_type(int x, int y){
-    if (cells[x][y].head){
-        char t = cells[x][y].head -> type;
+    cells.commit();
+    int pixel = x * ysize + y;
+    if (cells.size[pixel]){
+        char t = cells.type[cells.begin(pixel)];
         if (t == 'c'){
             return -1; 
         } else if (t == 'h'){
@@ -807,17 +952,27 @@ int Grid::pixel_type(int x, int y){
 }
 
 /**
- * Return the current glucose array
+ * Return a view of the current glucose field, indexed as view[x][y]
+ *
+ * The rows are stride values apart in a single block (see Field), which stays at the same address for the whole life of
+ * the grid, so that it can be shared without copies.
+ */
+FieldView<double> Grid::currentGlucose(){
+    return glucose.view();
+}
+
+/**
+ * Return a view of the current oxygen field, see currentGlucose
  */
-double ** Grid::currentGlucose(){
-    return glucose;
+FieldView<double> Grid::currentOxygen(){
+    return oxygen.view();
 }
 
 /**
- * Return the current oxygen array
+ * Return the dose received by each pixel (before the effect of hypoxia) during the last irradiation, row by row
  */
-double ** Grid::currentOxygen(){
-    return oxygen;
+double * Grid::currentDose(){
+    return dose_field;
 }
 
 /**
@@ -839,20 +994,14 @@ void Grid::irradiate(double dose, double radius){
 
 /**
  * Compute the average position of cancer cells on the grid
+ *
+ * The sums of the coordinates of the cancer cells are kept up to date by the CellStore, so this takes constant time.
  */
 void Grid::compute_center(){
-    int count = 0;
-    center_x = 0.0;
-    center_y = 0.0;
-    for (int i = 0; i < xsize; i++){
-        for (int j = 0; j < ysize; j++){
-            count += cells[i][j].ccell_count;
-            center_x += cells[i][j].ccell_count * i;
-            center_y += cells[i][j].ccell_count * j;
-        }
-    }
-    center_x /= count;
-    center_y /= count;
+    PhaseTimer timer(ctx.stats, COMPUTE_CENTER_PHASE);
+    cells.commit();
+    center_x = (double) cells.cancer_sum_x / cells.cancer_total;
+    center_y = (double) cells.cancer_sum_y / cells.cancer_total;
 }
 
 double Grid::get_center_x(){
@@ -861,4 +1010,18 @@ double Grid::get_center_x(){
 
 double Grid::get_center_y(){
     return center_y;
+}
+
+/**
+ * Replace the OARZone of the grid, used when a copy of the grid gets its own copy of the zone
+ */
+void Grid::set_oar_zone(OARZone * oar_zone){
+    oar = oar_zone;
+}
+
+/**
+ * Return the context holding the counters and random streams of this simulation
+ */
+SimContext * Grid::get_context(){
+    return &ctx;
 }
\ No newline at end of file
@@ -2,11 +2,18 @@
 #define RADIO_RL_GRID_H
 
 
+#include <vector>
 #include "cell.h"
+#include "cell_pool.h"
+#include "cell_store.h"
+#include "dose_map.h"
+#include "field.h"
+#include "sim_context.h"
+
+class ThreadPool;
 //https://www.codementor.io/@codementorteam/a-comprehensive-guide-to-implementation-of-singly-linked-list-using-c_plus_plus-ondlm5azr
 struct CellNode
 {
-    int x, y;
     Cell * cell;
     CellNode *next;
     char type;
@@ -22,16 +29,26 @@ class CellList
 public:
     CellNode *head, *tail;
     int size;
-    int oar_count;
-    int ccell_count;
     CellList();
+    CellList(CellPool * pool);
     ~CellList();
     void add(Cell * cell, char type);
     void deleteDeadAndSort();
-    int CellTypeSum();
-    void wake_oar();
-    void add(Cell *cell, char type, int x, int y);
     void add(CellNode * toAdd, char type);
+private:
+    CellPool * pool; // Where the cells and nodes are allocated, nullptr for the heap
+};
+
+/**
+ * Rectangle of pixels [x1, x2) x [y1, y2) cycled as a whole by one thread of the multithreaded cycle_cells, with its own
+ * random streams, changes of the population counters and created cells
+ */
+struct CycleTile {
+    CycleTile(int x1, int x2, int y1, int y2);
+    int x1, x2, y1, y2;
+    SimContext ctx;
+    CellColumns born;
+    bool has_dead;
 };
 
 struct Source{
@@ -48,11 +65,13 @@ public:
     void add(int x, int y);
 };
 class Grid {
+    friend class Checkpoint;
 public:
-    Grid(int xsize, int ysize, int sources_num);
-    Grid(int xsize, int ysize, int sources_num, OARZone * oar);
+    Grid(int xsize, int ysize, int sources_num, unsigned int seed);
+    Grid(int xsize, int ysize, int sources_num, OARZone * oar, unsigned int seed);
+    Grid(const Grid & other);
     ~Grid();
-    void addCell(int x, int y, Cell * cell, char type);
+    void addCell(int x, int y, char type, char stage);
     void fill_sources(double glu, double oxy);
     void cycle_cells();
     void diffuse(double diff_factor);
@@ -61,38 +80,58 @@ public:
     void irradiate(double dose, double radius, double center_x, double center_y);
     int pixel_type(int x, int y);
     int pixel_density(int x, int y);
-    double ** currentGlucose();
-    double ** currentOxygen();
+    FieldView<double> currentGlucose();
+    FieldView<double> currentOxygen();
+    double * currentDose();
     double tumor_radius(int center_x, int center_y);
     void compute_center();
     double get_center_x();
     double get_center_y();
+    SimContext * get_context();
+    void set_oar_zone(OARZone * oar_zone);
+    void set_cycle_threads(int num_threads, int tile_size);
+    int get_cycle_threads();
 private:
+    bool cycle_pixel(int x, SimContext * c, CellColumns & born);
+    template <char TYPE>
+    void cycle_run(int first, int last, int i, int j, int neigh_count, SimContext * c, CellColumns & born);
+    void cycle_tiles();
     void change_neigh_counts(int x, int y, int val);
-    int rand_min(int x, int y, int max);
-    int rand_adj(int x, int y);
-    int find_missing_oar(int x, int y);
+    int rand_min(int x, int y, int max, SimContext * c);
+    int rand_adj(int x, int y, SimContext * c);
+    int find_missing_oar(int x, int y, SimContext * c);
     void min_helper(int x, int y, int& curr_min, int * pos, int& counter);
     void adj_helper(int x, int y, int * pos, int& counter);
     void missing_oar_helper(int x, int y, int&  curr_min, int * pos, int& counter);
     void wake_surrounding_oar(int x, int y);
     void wake_helper(int x, int y);
     int rand_cycle(int num);
-    void addToGrid(CellList * newCells);
     int sourceMove(int x, int y);
     int xsize;
     int ysize;
-    CellList ** cells;
-    double ** glucose;
-    double ** oxygen;
-    double ** glucose_helper;
-    double ** oxygen_helper;
-    int ** neigh_counts;
+    CellStore cells;
+    Field<double> glucose; // Its halo stays at zero, see diffuse_fields
+    Field<double> oxygen;
+    Field<int> neigh_counts; // Its halo receives the counts of the pixels outside of the grid, which are never read
+    double * diffusion_lines;
+    double * dose_field; // Dose received by each pixel during the last irradiation, see currentDose
+    DoseProfile dose_profile;
+    PixelBox dose_box; // Pixels that may have been reached by the last irradiation
     SourceList * sources;
     OARZone * oar;
+    SimContext ctx;
     double center_x;
     double center_y;
-    int * rand_helper;
+    int radius_version; // Version of the cells (see CellStore::version) and center for which radius_cache was computed
+    int radius_center_x;
+    int radius_center_y;
+    double radius_cache;
+    CellColumns born; // Cells created during the current call to cycle_cells, when it runs on a single thread
+    int cycle_threads; // Number of threads of cycle_cells, 1 for the original serial order
+    int tile_size;
+    ThreadPool * cycle_pool;
+    std::vector<CycleTile> tiles; // Sorted by colour, see set_cycle_threads
+    int colour_offsets[5]; // The tiles of colour c are at indices [colour_offsets[c], colour_offsets[c + 1])
 };
 
 
@@ -8,11 +8,98 @@
 #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
 #include <Python.h>
 #include "controller.h"
+#include "vec_controller.h"
+#include "checkpoint.h"
+#include "trace.h"
 #include <numpy/npy_common.h>
 #include <numpy/arrayobject.h>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Seed given to controllers created without an explicit one, incremented so that every simulation gets its own stream
+static unsigned int next_seed = 5;
+
+struct StepJob;
+
+/*
+ * A Controller is shared between its capsule, the numpy views of its nutrient fields (see field_view) and the
+ * asynchronous steps running on it (see go_async). It is only deleted once its capsule has been released (by
+ * delete_controller or by the garbage collector) and no view of its memory or step handle remains.
+ */
+struct ControllerOwnership {
+    Controller * controller;
+    int owners; // The capsule, until it is released, every living view and every step handle
+    bool capsule_released;
+    StepJob * pending; // Asynchronous step still running or not joined yet, NULL if none
+};
+
+/*
+ * Asynchronous simulation of num_steps hours of a controller on its own thread, referenced by a "StepFuturePtr"
+ * capsule. The controller must not be touched until the thread has been joined, which every binding does first through
+ * get_controller.
+ */
+struct StepJob {
+    ControllerOwnership * ownership;
+    std::thread thread;
+    std::mutex join_mutex; // Held while joining the thread, which several Python threads may wait for
+    std::atomic<bool> done;
+};
+
+static void release_ownership(ControllerOwnership * ownership){
+    if (--ownership -> owners == 0){
+        delete ownership -> controller;
+        delete ownership;
+    }
+}
+
+// Wait for an asynchronous step to finish, without holding the GIL
+static void join_step(StepJob * job){
+    Py_BEGIN_ALLOW_THREADS
+    {
+        std::lock_guard<std::mutex> lock(job -> join_mutex);
+        if (job -> thread.joinable())
+            job -> thread.join();
+    }
+    Py_END_ALLOW_THREADS
+    if (job -> ownership -> pending == job)
+        job -> ownership -> pending = NULL;
+}
+
+static void release_controller_capsule(PyObject* controllerCapsule){
+    ControllerOwnership * ownership = (ControllerOwnership *) PyCapsule_GetContext(controllerCapsule);
+    if (ownership && !ownership -> capsule_released){
+        ownership -> capsule_released = true;
+        release_ownership(ownership);
+    }
+}
 
+static void release_view(PyObject* viewCapsule){
+    release_ownership((ControllerOwnership *) PyCapsule_GetPointer(viewCapsule, "ControllerView"));
+}
 
+// Create the capsule through which Python holds a Controller
+static PyObject* wrap_controller(Controller * controller){
+    PyObject* controllerCapsule = PyCapsule_New((void *)controller, "ControllerPtr", release_controller_capsule);
+    if (controllerCapsule == NULL){
+        delete controller;
+        return NULL;
+    }
+    PyCapsule_SetContext(controllerCapsule, new ControllerOwnership{controller, 1, false, NULL});
+    return controllerCapsule;
+}
+
+// Return the Controller held by a capsule, once the asynchronous step running on it (if any) is over
+static Controller * get_controller(PyObject* controllerCapsule){
+    Controller * controller = (Controller *) PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    ControllerOwnership * ownership = (ControllerOwnership *) PyCapsule_GetContext(controllerCapsule);
+    if (ownership && ownership -> pending)
+        join_step(ownership -> pending);
+    return controller;
+}
 
 PyObject* controller_constructor(PyObject* self, PyObject* args){
     // Arguments passed from Python
@@ -20,23 +107,24 @@ PyObject* controller_constructor(PyObject* self, PyObject* args){
     int ysize;
     int source_nums;
     int init_steps;
+    unsigned int seed = next_seed++;
 
     // Process arguments passes from Python
-    PyArg_ParseTuple(args, "iiii",
+    PyArg_ParseTuple(args, "iiii|I",
                      &xsize,
                      &ysize,
                      &source_nums,
-                     &init_steps);
-
-    Controller * controller = new Controller(1000, xsize, ysize, source_nums);
+                     &init_steps,
+                     &seed);
 
-    PyObject* controllerCapsule = PyCapsule_New((void *)controller, "ControllerPtr", NULL);
-    PyCapsule_SetPointer(controllerCapsule, (void *)controller);
+    Controller * controller = new Controller(1000, xsize, ysize, source_nums, seed);
 
+    Py_BEGIN_ALLOW_THREADS
     for (int i = 0; i < init_steps; i++)
         controller -> go();
+    Py_END_ALLOW_THREADS
 
-    return Py_BuildValue("O", controllerCapsule);
+    return wrap_controller(controller);
 }
 
 PyObject* controller_constructor_oar(PyObject* self, PyObject* args){
@@ -46,9 +134,10 @@ PyObject* controller_constructor_oar(PyObject* self, PyObject* args){
     int source_nums;
     int init_steps;
     int x1, x2, y1, y2;
+    unsigned int seed = next_seed++;
 
     // Process arguments passes from Python
-    PyArg_ParseTuple(args, "iiiiiiii",
+    PyArg_ParseTuple(args, "iiiiiiii|I",
                      &xsize,
                      &ysize,
                      &source_nums,
@@ -56,21 +145,230 @@ PyObject* controller_constructor_oar(PyObject* self, PyObject* args){
                      &x1,
                      &x2,
                      &y1,
-                     &y2);
+                     &y2,
+                     &seed);
 
-    Controller * controller = new Controller(1000, xsize, ysize, source_nums, x1, x2, y1, y2);
-
-    PyObject* controllerCapsule = PyCapsule_New((void *)controller, "ControllerPtr", NULL);
-    PyCapsule_SetPointer(controllerCapsule, (void *)controller);
+    Controller * controller = new Controller(1000, xsize, ysize, source_nums, x1, x2, y1, y2, seed);
 
+    Py_BEGIN_ALLOW_THREADS
     for (int i = 0; i < init_steps; i++)
         controller -> go();
+    Py_END_ALLOW_THREADS
+
+    return wrap_controller(controller);
+}
+
+PyObject* controller_snapshot(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+
+    if (!PyArg_ParseTuple(args, "O",
+                          &controllerCapsule))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
+        return NULL;
+    Controller* snapshot = controller -> snapshot();
+
+    return wrap_controller(snapshot);
+}
+
+PyObject* reset_from(PyObject* self, PyObject* args){
+    PyObject* snapshotCapsule;
+    int reseed = 1;
+    unsigned int seed = next_seed++;
+
+    if (!PyArg_ParseTuple(args, "O|pI",
+                          &snapshotCapsule,
+                          &reseed,
+                          &seed))
+        return NULL;
+
+    Controller* snapshot = get_controller(snapshotCapsule);
+    if (snapshot == NULL)
+        return NULL;
+    Controller* controller = reseed ? snapshot -> clone(seed) : snapshot -> snapshot();
 
-    return Py_BuildValue("O", controllerCapsule);
+    return wrap_controller(controller);
 }
 
+PyObject* save_checkpoint(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+    const char * path;
+
+    if (!PyArg_ParseTuple(args, "Os",
+                          &controllerCapsule,
+                          &path))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
+        return NULL;
+    if (!Checkpoint::save(controller, path))
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+
+    Py_RETURN_NONE;
+}
+
+PyObject* load_checkpoint(PyObject* self, PyObject* args){
+    const char * path;
+    int reseed = 0;
+    unsigned int seed = next_seed++;
+
+    if (!PyArg_ParseTuple(args, "s|pI",
+                          &path,
+                          &reseed,
+                          &seed))
+        return NULL;
+
+    Controller* controller = Checkpoint::load(path);
+    if (controller == NULL){
+        PyErr_Format(PyExc_IOError, "%s is not a readable checkpoint of version %d", path, CHECKPOINT_VERSION);
+        return NULL;
+    }
+    if (reseed)
+        controller -> reseed(seed);
+
+    return wrap_controller(controller);
+}
+
+PyObject* save_checkpoint_library(PyObject* self, PyObject* args){
+    const char * path;
+    PyObject* capsules;
+
+    if (!PyArg_ParseTuple(args, "sO",
+                          &path,
+                          &capsules))
+        return NULL;
+
+    PyObject* sequence = PySequence_Fast(capsules, "controllers must be a sequence of controllers");
+    if (sequence == NULL)
+        return NULL;
+    int count = (int) PySequence_Fast_GET_SIZE(sequence);
+    Controller** controllers = new Controller*[count];
+    for (int i = 0; i < count; i++){
+        controllers[i] = get_controller(PySequence_Fast_GET_ITEM(sequence, i));
+        if (controllers[i] == NULL){
+            delete[] controllers;
+            Py_DECREF(sequence);
+            return NULL;
+        }
+    }
+    bool saved = Checkpoint::save_library(controllers, count, path);
+    delete[] controllers;
+    Py_DECREF(sequence);
+    if (!saved)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+
+    Py_RETURN_NONE;
+}
+
+// Stands for the library of a capsule once close_checkpoint_library has unmapped it
+static char closed_library;
+
+static void release_library(PyObject* libraryCapsule){
+    void * library = PyCapsule_GetPointer(libraryCapsule, "CheckpointLibraryPtr");
+    if (library != &closed_library)
+        delete (CheckpointLibrary *) library;
+}
+
+// Return the library held by a capsule, or NULL with a Python exception set if it has been closed
+static CheckpointLibrary * get_library(PyObject* libraryCapsule){
+    void * library = PyCapsule_GetPointer(libraryCapsule, "CheckpointLibraryPtr");
+    if (library == &closed_library){
+        PyErr_SetString(PyExc_ValueError, "the checkpoint library is closed");
+        return NULL;
+    }
+    return (CheckpointLibrary *) library;
+}
+
+PyObject* open_checkpoint_library(PyObject* self, PyObject* args){
+    const char * path;
+
+    if (!PyArg_ParseTuple(args, "s",
+                          &path))
+        return NULL;
+
+    CheckpointLibrary* library = new CheckpointLibrary(path);
+    if (!library -> is_open()){
+        delete library;
+        PyErr_Format(PyExc_IOError, "%s is not a readable checkpoint library of version %d", path, CHECKPOINT_VERSION);
+        return NULL;
+    }
+
+    PyObject* libraryCapsule = PyCapsule_New((void *)library, "CheckpointLibraryPtr", release_library);
+    if (libraryCapsule == NULL){
+        delete library;
+        return NULL;
+    }
+    return libraryCapsule;
+}
+
+PyObject* library_size(PyObject* self, PyObject* args){
+    PyObject* libraryCapsule;
+
+    if (!PyArg_ParseTuple(args, "O",
+                          &libraryCapsule))
+        return NULL;
+
+    CheckpointLibrary* library = get_library(libraryCapsule);
+    if (library == NULL)
+        return NULL;
+
+    return Py_BuildValue("i", library -> size());
+}
+
+PyObject* library_instantiate(PyObject* self, PyObject* args){
+    PyObject* libraryCapsule;
+    int index;
+    int reseed = 0;
+    unsigned int seed = next_seed++;
+
+    if (!PyArg_ParseTuple(args, "Oi|pI",
+                          &libraryCapsule,
+                          &index,
+                          &reseed,
+                          &seed))
+        return NULL;
+
+    CheckpointLibrary* library = get_library(libraryCapsule);
+    if (library == NULL)
+        return NULL;
+    if (index < 0 || index >= library -> size()){
+        PyErr_SetString(PyExc_IndexError, "checkpoint index out of range");
+        return NULL;
+    }
+    Controller* controller = library -> instantiate(index);
+    if (controller == NULL){
+        PyErr_Format(PyExc_ValueError, "checkpoint %d of the library is invalid", index);
+        return NULL;
+    }
+    if (reseed)
+        controller -> reseed(seed);
+
+    return wrap_controller(controller);
+}
+
+PyObject* close_checkpoint_library(PyObject* self, PyObject* args){
+    PyObject* libraryCapsule;
+
+    if (!PyArg_ParseTuple(args, "O",
+                          &libraryCapsule))
+        return NULL;
+
+    void * library = PyCapsule_GetPointer(libraryCapsule, "CheckpointLibraryPtr");
+    if (library == NULL)
+        return NULL;
+    if (library != &closed_library){ // Closing twice does nothing
+        delete (CheckpointLibrary *) library;
+        PyCapsule_SetPointer(libraryCapsule, &closed_library);
+    }
+
+    Py_RETURN_NONE;
+}
 
 PyObject* go(PyObject* self, PyObject* args){
+    TraceScope scope("go");
     PyObject* controllerCapsule;
     int num_steps;
 
@@ -78,30 +376,123 @@ PyObject* go(PyObject* self, PyObject* args){
                      &controllerCapsule,
                      &num_steps);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
 
+    Py_BEGIN_ALLOW_THREADS
     for (int i = 0; i < num_steps; i++)
         controller -> go();
-    //std::cout << "Tick : " << controller->tick << " HCells : " << HealthyCell::count << " CCells : " << CancerCell::count << std::endl;
+    Py_END_ALLOW_THREADS
+    //std::cout << "Tick : " << controller->tick << " HCells : " << controller->hcell_count() << " CCells : " << controller->ccell_count() << std::endl;
     
     Py_RETURN_NONE;
 }
 
+static void release_step(PyObject* futureCapsule){
+    StepJob * job = (StepJob *) PyCapsule_GetPointer(futureCapsule, "StepFuturePtr");
+    join_step(job);
+    release_ownership(job -> ownership);
+    delete job;
+}
+
+/*
+ * Start simulating num_steps hours of a controller on a separate thread and return immediately with a handle on the
+ * step, so that Python can do other work in the meantime. Any other use of the controller waits for the step to be over,
+ * as does step_wait. Numpy views of the nutrient fields should not be read while the step is running.
+ */
+PyObject* go_async(PyObject* self, PyObject* args){
+    TraceScope scope("go_async");
+    PyObject* controllerCapsule;
+    int num_steps;
+
+    if (!PyArg_ParseTuple(args, "Oi",
+                          &controllerCapsule,
+                          &num_steps))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    ControllerOwnership * ownership = (ControllerOwnership *) PyCapsule_GetContext(controllerCapsule);
+
+    StepJob * job = new StepJob();
+    job -> ownership = ownership;
+    job -> done = false;
+    PyObject* futureCapsule = PyCapsule_New((void *)job, "StepFuturePtr", release_step);
+    if (futureCapsule == NULL){
+        delete job;
+        return NULL;
+    }
+    ownership -> owners++;
+    ownership -> pending = job;
+    job -> thread = std::thread([controller, num_steps, job](){
+        TraceScope scope("go_async step");
+        for (int i = 0; i < num_steps; i++)
+            controller -> go();
+        job -> done = true;
+    });
+    return futureCapsule;
+}
+
+// Return whether an asynchronous step is over, without waiting for it
+PyObject* step_done(PyObject* self, PyObject* args){
+    PyObject* futureCapsule;
+    if (!PyArg_ParseTuple(args, "O",
+                          &futureCapsule))
+        return NULL;
+
+    StepJob * job = (StepJob *) PyCapsule_GetPointer(futureCapsule, "StepFuturePtr");
+    return PyBool_FromLong(job -> done);
+}
+
+/*
+ * Choose how many threads the controller uses to advance its cells by one hour. With more than one, the simulation
+ * depends on the tile size (default 8) but not on the number of threads.
+ */
+PyObject* set_cycle_threads(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+    int num_threads;
+    int tile_size = 8;
+    if (!PyArg_ParseTuple(args, "Oi|i",
+                          &controllerCapsule,
+                          &num_threads,
+                          &tile_size))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
+        return NULL;
+    controller -> set_cycle_threads(num_threads, tile_size);
+    Py_RETURN_NONE;
+}
+
+// Wait for an asynchronous step to be over
+PyObject* step_wait(PyObject* self, PyObject* args){
+    PyObject* futureCapsule;
+    if (!PyArg_ParseTuple(args, "O",
+                          &futureCapsule))
+        return NULL;
+
+    join_step((StepJob *) PyCapsule_GetPointer(futureCapsule, "StepFuturePtr"));
+    Py_RETURN_NONE;
+}
+
 
 PyObject* irradiate(PyObject* self, PyObject* args){
+    TraceScope scope("irradiate");
     PyObject* controllerCapsule;
     double dose;
 
     PyArg_ParseTuple(args, "Od",
                      &controllerCapsule,
                      &dose);
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
+    Py_BEGIN_ALLOW_THREADS
     controller -> irradiate(dose);
+    Py_END_ALLOW_THREADS
     
     Py_RETURN_NONE;
 }
 
 PyObject* irradiate_radius(PyObject* self, PyObject* args){
+    TraceScope scope("irradiate_radius");
     PyObject* controllerCapsule;
     double dose;
     double radius;
@@ -110,13 +501,16 @@ PyObject* irradiate_radius(PyObject* self, PyObject* args){
                      &dose,
                      &radius);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
+    Py_BEGIN_ALLOW_THREADS
     controller -> irradiate(dose, radius);
+    Py_END_ALLOW_THREADS
 
     Py_RETURN_NONE;
 }
 
 PyObject* irradiate_center_radius(PyObject* self, PyObject* args){
+    TraceScope scope("irradiate_center_radius");
     PyObject* controllerCapsule;
     double dose;
     double radius;
@@ -125,21 +519,26 @@ PyObject* irradiate_center_radius(PyObject* self, PyObject* args){
                      &dose,
                      &radius);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
+    Py_BEGIN_ALLOW_THREADS
     controller -> irradiate_center(dose, radius);
+    Py_END_ALLOW_THREADS
 
     Py_RETURN_NONE;
 }
 
 PyObject* irradiate_center(PyObject* self, PyObject* args){
+    TraceScope scope("irradiate_center");
     PyObject* controllerCapsule;
     double dose;
     PyArg_ParseTuple(args, "Od",
                      &controllerCapsule,
                      &dose);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
+    Py_BEGIN_ALLOW_THREADS
     controller -> irradiate_center(dose);
+    Py_END_ALLOW_THREADS
 
     Py_RETURN_NONE;
 }
@@ -149,23 +548,39 @@ PyObject* delete_controller(PyObject* self, PyObject* args){
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
-
-    delete controller;
+    release_controller_capsule(controllerCapsule);
 
     Py_RETURN_NONE;
 }
 
-PyObject *HCellCount(PyObject *self) {
-   return Py_BuildValue("i", HealthyCell::count);
+PyObject* HCellCount(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+    PyArg_ParseTuple(args, "O",
+                     &controllerCapsule);
+
+    Controller* controller = get_controller(controllerCapsule);
+
+    return Py_BuildValue("i", controller -> hcell_count());
 }
 
-PyObject *CCellCount(PyObject *self) {
-   return Py_BuildValue("i", CancerCell::count);
+PyObject* CCellCount(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+    PyArg_ParseTuple(args, "O",
+                     &controllerCapsule);
+
+    Controller* controller = get_controller(controllerCapsule);
+
+    return Py_BuildValue("i", controller -> ccell_count());
 }
 
-PyObject *OARCellCount(PyObject *self) {
-   return Py_BuildValue("i", OARCell::count);
+PyObject* OARCellCount(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+    PyArg_ParseTuple(args, "O",
+                     &controllerCapsule);
+
+    Controller* controller = get_controller(controllerCapsule);
+
+    return Py_BuildValue("i", controller -> oar_count());
 }
 
 PyObject* controllerTick(PyObject* self, PyObject* args){
@@ -173,17 +588,113 @@ PyObject* controllerTick(PyObject* self, PyObject* args){
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
 
     return Py_BuildValue("i", controller -> tick);
 }
 
+// Set key of a dict to a new reference, which is released
+static void set_stat(PyObject* dict, const std::string & key, PyObject* value){
+    PyDict_SetItemString(dict, key.c_str(), value);
+    Py_DECREF(value);
+}
+
+PyObject* stats(PyObject* self, PyObject* args){
+    PyObject* controllerCapsule;
+    int reset = 0;
+    if (!PyArg_ParseTuple(args, "O|p",
+                          &controllerCapsule,
+                          &reset))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
+        return NULL;
+    SimStats * stats = controller -> get_stats();
+    PyObject* dict = PyDict_New();
+    for (int phase = 0; phase < PHASE_COUNT; phase++){
+        std::string name = SimStats::phase_name(phase);
+        set_stat(dict, name + "_seconds", PyFloat_FromDouble(stats -> phase_seconds[phase]));
+        set_stat(dict, name + "_calls", PyLong_FromLongLong(stats -> phase_calls[phase]));
+    }
+    set_stat(dict, "cells_cycled", PyLong_FromLongLong(stats -> cells_cycled));
+    set_stat(dict, "mitoses", PyLong_FromLongLong(stats -> mitoses));
+    set_stat(dict, "starvation_deaths", PyLong_FromLongLong(stats -> starvation_deaths));
+    set_stat(dict, "radiation_deaths", PyLong_FromLongLong(stats -> radiation_deaths));
+    set_stat(dict, "allocations", PyLong_FromLongLong(stats -> allocations));
+    set_stat(dict, "compactions", PyLong_FromLongLong(stats -> compactions));
+#ifdef RADIO_RL_NO_STATS
+    set_stat(dict, "enabled", PyBool_FromLong(0));
+#else
+    set_stat(dict, "enabled", PyBool_FromLong(1));
+#endif
+    if (reset)
+        stats -> reset();
+    return dict;
+}
+
+/*
+ * Start recording the timeline of the simulations and of the calls of the bindings (see Trace), keeping the last
+ * capacity events
+ */
+PyObject* trace_start(PyObject* self, PyObject* args){
+    int capacity = 1 << 20;
+    if (!PyArg_ParseTuple(args, "|i",
+                          &capacity))
+        return NULL;
+
+    Trace::start(capacity);
+    Py_RETURN_NONE;
+}
+
+PyObject* trace_stop(PyObject* self, PyObject* args){
+    Trace::stop();
+    Py_RETURN_NONE;
+}
+
+/*
+ * Mark the beginning or the end of a scope of the Python code (a training update for instance) in the timeline, so that
+ * it appears next to the simulation
+ */
+static PyObject* trace_mark(PyObject* args, char phase){
+    const char * name;
+    if (!PyArg_ParseTuple(args, "s",
+                          &name))
+        return NULL;
+
+    Trace::record(name, phase, Trace::now(), 0);
+    Py_RETURN_NONE;
+}
+
+PyObject* trace_begin(PyObject* self, PyObject* args){
+    return trace_mark(args, 'B');
+}
+
+PyObject* trace_end(PyObject* self, PyObject* args){
+    return trace_mark(args, 'E');
+}
+
+// Write the recorded events to a Chrome trace JSON file and return their number
+PyObject* trace_dump(PyObject* self, PyObject* args){
+    const char * name;
+    if (!PyArg_ParseTuple(args, "s",
+                          &name))
+        return NULL;
+
+    try {
+        return Py_BuildValue("i", Trace::dump(name));
+    } catch (const std::exception & e){
+        PyErr_SetString(PyExc_IOError, e.what());
+        return NULL;
+    }
+}
+
 PyObject* tumor_radius(PyObject* self, PyObject* args){
     PyObject* controllerCapsule;
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
 
     return Py_BuildValue("f", controller -> tumor_radius());
 }
@@ -193,7 +704,7 @@ PyObject* get_center_x(PyObject* self, PyObject* args){
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
 
     return Py_BuildValue("f", controller -> get_center_x());
 }
@@ -203,12 +714,13 @@ PyObject* get_center_y(PyObject* self, PyObject* args){
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
 
     return Py_BuildValue("f", controller -> get_center_y());
 }
 
 PyObject* observeDensity(PyObject* self, PyObject* args){
+    TraceScope scope("observeDensity");
     PyObject* controllerCapsule;
     int ** out_dataptr;
     NpyIter *out_iter;
@@ -219,7 +731,7 @@ PyObject* observeDensity(PyObject* self, PyObject* args){
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
     npy_intp dims[2] = {controller->xsize, controller->ysize};
     out_array = PyArray_SimpleNew(2, dims, NPY_INT);
     if (out_array == NULL)
@@ -252,6 +764,7 @@ PyObject* observeDensity(PyObject* self, PyObject* args){
 }
 
 PyObject* observeSegmentation(PyObject* self, PyObject* args){
+    TraceScope scope("observeSegmentation");
     PyObject* controllerCapsule;
     int ** out_dataptr;
     NpyIter *out_iter;
@@ -262,7 +775,7 @@ PyObject* observeSegmentation(PyObject* self, PyObject* args){
     PyArg_ParseTuple(args, "O",
                      &controllerCapsule);
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
+    Controller* controller = get_controller(controllerCapsule);
     npy_intp dims[2] = {controller->xsize, controller->ysize};
     out_array = PyArray_SimpleNew(2, dims, NPY_INT);
     if (out_array == NULL)
@@ -295,98 +808,388 @@ PyObject* observeSegmentation(PyObject* self, PyObject* args){
 }
 
 
-PyObject* observeGlucose(PyObject* self, PyObject* args){
-    PyObject* controllerCapsule;
-    double ** out_dataptr;
-    NpyIter *out_iter;
-    int x = 0;
-    NpyIter_IterNextFunc *out_iternext;
-    PyObject* out_array;
-    double ** glucose;
-    PyArg_ParseTuple(args, "O",
-                     &controllerCapsule);
-
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
-    
-    glucose = controller->currentGlucose();
-    
+/*
+ * Return a read-only numpy array of shape (xsize, ysize) wrapping a nutrient field of the controller, without copying
+ * it. The array follows the simulation as it advances, and keeps the controller alive for as long as it exists. If copy
+ * is true, an independent (writeable) copy of the field is returned instead. The rows of the field are stride values
+ * apart, the array skipping the halo and padding of the nutrient fields (see Field).
+ */
+static PyObject* field_view(PyObject* controllerCapsule, double * field, int stride, bool copy){
+    Controller* controller = get_controller(controllerCapsule);
     npy_intp dims[2] = {controller->xsize, controller->ysize};
-    out_array = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
-    if (out_array == NULL)
+    npy_intp strides[2] = {(npy_intp) (stride * sizeof(double)), sizeof(double)};
+    PyObject* view = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, strides, field, 0, 0, NULL);
+    if (view == NULL)
         return NULL;
-    
-    out_iter = NpyIter_New((PyArrayObject *)out_array, NPY_ITER_READWRITE,
-                          NPY_KEEPORDER, NPY_NO_CASTING, NULL);
-    if (out_iter == NULL) {
-        NpyIter_Deallocate(out_iter);
-        goto fail;
+    PyArray_CLEARFLAGS((PyArrayObject *) view, NPY_ARRAY_WRITEABLE);
+    if (copy){
+        PyObject* out_array = PyArray_NewCopy((PyArrayObject *) view, NPY_CORDER);
+        Py_DECREF(view);
+        return out_array;
     }
-    out_iternext = NpyIter_GetIterNext(out_iter, NULL);
-    if (out_iternext == NULL) {
-        NpyIter_Deallocate(out_iter);
-        goto fail;
+
+    ControllerOwnership * ownership = (ControllerOwnership *) PyCapsule_GetContext(controllerCapsule);
+    ownership -> owners++;
+    PyObject* viewCapsule = PyCapsule_New((void *)ownership, "ControllerView", release_view);
+    if (viewCapsule == NULL){
+        ownership -> owners--;
+        Py_DECREF(view);
+        return NULL;
     }
-    out_dataptr = (double **) NpyIter_GetDataPtrArray(out_iter);
-    do {
-        **out_dataptr = glucose[x / controller -> ysize][x % controller -> ysize];
-        x++;
-    } while(out_iternext(out_iter));
+    if (PyArray_SetBaseObject((PyArrayObject *) view, viewCapsule) < 0){ // Steals the reference to viewCapsule
+        Py_DECREF(view);
+        return NULL;
+    }
+    return view;
+}
 
-    Py_INCREF(out_array);
-    NpyIter_Deallocate(out_iter);
-    return out_array;
+PyObject* observeGlucose(PyObject* self, PyObject* args){
+    TraceScope scope("observeGlucose");
+    PyObject* controllerCapsule;
+    int copy = 0;
+    if (!PyArg_ParseTuple(args, "O|p",
+                          &controllerCapsule,
+                          &copy))
+        return NULL;
 
-    fail:
-        Py_XDECREF(out_array);
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
         return NULL;
+
+    FieldView<double> glucose = controller->currentGlucose();
+    return field_view(controllerCapsule, glucose.origin, glucose.stride, copy);
 }
 
 PyObject* observeOxygen(PyObject* self, PyObject* args){
+    TraceScope scope("observeOxygen");
     PyObject* controllerCapsule;
-    double ** out_dataptr;
-    NpyIter *out_iter;
-    int x = 0;
-    NpyIter_IterNextFunc *out_iternext;
-    PyObject* out_array;
-    double ** oxygen;
-    PyArg_ParseTuple(args, "O",
-                     &controllerCapsule);
+    int copy = 0;
+    if (!PyArg_ParseTuple(args, "O|p",
+                          &controllerCapsule,
+                          &copy))
+        return NULL;
 
-    Controller* controller = (Controller*)PyCapsule_GetPointer(controllerCapsule, "ControllerPtr");
-    
-    oxygen = controller->currentOxygen();
-    
-    npy_intp dims[2] = {controller->xsize, controller->ysize};
-    out_array = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
-    if (out_array == NULL)
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
         return NULL;
-    
-    out_iter = NpyIter_New((PyArrayObject *)out_array, NPY_ITER_READWRITE,
-                          NPY_KEEPORDER, NPY_NO_CASTING, NULL);
-    if (out_iter == NULL) {
-        NpyIter_Deallocate(out_iter);
-        goto fail;
+
+    FieldView<double> oxygen = controller->currentOxygen();
+    return field_view(controllerCapsule, oxygen.origin, oxygen.stride, copy);
+}
+
+/*
+ * Fill a numpy array of shape (xsize, ysize, 3) with the segmentation, glucose and oxygen of each pixel, each multiplied
+ * by the corresponding scale, in a single pass. The array is of type float32 or uint8 (rounded and clamped to [0, 255]),
+ * and is either given by the caller in out (C-contiguous and writeable) or newly allocated.
+ */
+PyObject* observeState(PyObject* self, PyObject* args){
+    TraceScope scope("observeState");
+    PyObject* controllerCapsule;
+    double scales[3] = {1.0, 1.0, 1.0};
+    PyObject* dtype_arg = NULL;
+    PyObject* out_arg = Py_None;
+    if (!PyArg_ParseTuple(args, "O|(ddd)OO",
+                          &controllerCapsule,
+                          &scales[0], &scales[1], &scales[2],
+                          &dtype_arg,
+                          &out_arg))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
+        return NULL;
+    int type_num = NPY_FLOAT32;
+    if (dtype_arg != NULL && dtype_arg != Py_None){
+        PyArray_Descr* descr;
+        if (!PyArray_DescrConverter(dtype_arg, &descr))
+            return NULL;
+        type_num = descr -> type_num;
+        Py_DECREF(descr);
     }
-    out_iternext = NpyIter_GetIterNext(out_iter, NULL);
-    if (out_iternext == NULL) {
-        NpyIter_Deallocate(out_iter);
-        goto fail;
+
+    PyObject* out_array;
+    if (out_arg == Py_None){
+        if (type_num != NPY_FLOAT32 && type_num != NPY_UINT8){
+            PyErr_SetString(PyExc_TypeError, "dtype must be float32 or uint8");
+            return NULL;
+        }
+        npy_intp dims[3] = {controller->xsize, controller->ysize, 3};
+        out_array = PyArray_SimpleNew(3, dims, type_num);
+        if (out_array == NULL)
+            return NULL;
+    } else {
+        PyArrayObject* out = (PyArrayObject *) out_arg;
+        if (!PyArray_Check(out_arg) || PyArray_NDIM(out) != 3 || PyArray_DIM(out, 0) != controller->xsize ||
+            PyArray_DIM(out, 1) != controller->ysize || PyArray_DIM(out, 2) != 3){
+            PyErr_SetString(PyExc_ValueError, "out must be an array of shape (xsize, ysize, 3)");
+            return NULL;
+        }
+        if (!PyArray_IS_C_CONTIGUOUS(out) || !PyArray_ISWRITEABLE(out)){
+            PyErr_SetString(PyExc_ValueError, "out must be C-contiguous and writeable");
+            return NULL;
+        }
+        type_num = PyArray_TYPE(out);
+        if (type_num != NPY_FLOAT32 && type_num != NPY_UINT8){
+            PyErr_SetString(PyExc_TypeError, "out must be of type float32 or uint8");
+            return NULL;
+        }
+        out_array = out_arg;
+        Py_INCREF(out_array);
     }
-    out_dataptr = (double **) NpyIter_GetDataPtrArray(out_iter);
-    do {
-        **out_dataptr = oxygen[x / controller -> ysize][x % controller -> ysize];
-        x++;
-    } while(out_iternext(out_iter));
 
-    Py_INCREF(out_array);
-    NpyIter_Deallocate(out_iter);
+    void * data = PyArray_DATA((PyArrayObject *) out_array);
+    if (type_num == NPY_FLOAT32)
+        controller->observe_state((float *) data, scales);
+    else
+        controller->observe_state((unsigned char *) data, scales);
     return out_array;
+}
 
-    fail:
-        Py_XDECREF(out_array);
+PyObject* observeDose(PyObject* self, PyObject* args){
+    TraceScope scope("observeDose");
+    PyObject* controllerCapsule;
+    int copy = 0;
+    if (!PyArg_ParseTuple(args, "O|p",
+                          &controllerCapsule,
+                          &copy))
+        return NULL;
+
+    Controller* controller = get_controller(controllerCapsule);
+    if (controller == NULL)
         return NULL;
+
+    return field_view(controllerCapsule, controller->currentDose(), controller->ysize, copy);
+}
+
+
+// Stands for the batch of a capsule once delete_vec_controller has deleted it
+static char deleted_vec;
+
+static void release_vec(PyObject* vecCapsule){
+    void * vec = PyCapsule_GetPointer(vecCapsule, "VecControllerPtr");
+    if (vec != &deleted_vec)
+        delete (VecController *) vec;
+}
+
+// Return the batch held by a capsule, or NULL with a Python exception set if it has been deleted
+static VecController * get_vec(PyObject* vecCapsule){
+    void * vec = PyCapsule_GetPointer(vecCapsule, "VecControllerPtr");
+    if (vec == &deleted_vec){
+        PyErr_SetString(PyExc_ValueError, "the batch of controllers is deleted");
+        return NULL;
+    }
+    return (VecController *) vec;
+}
+
+// Allocate the (K, xsize, ysize, 3) array of the observations of a batch, of the type it was created with
+static PyObject* new_vec_observations(VecController * vec){
+    npy_intp obs_dims[4] = {vec -> num_envs, vec -> xsize, vec -> ysize, 3};
+    return PyArray_SimpleNew(4, obs_dims, vec -> byte_observations ? NPY_UINT8 : NPY_FLOAT32);
+}
+
+/*
+ * Create a batch of controllers, whose observations are the agent states of observeState with the given scales and
+ * dtype (float32 or uint8)
+ */
+PyObject* vec_constructor(PyObject* self, PyObject* args){
+    int num_envs;
+    int xsize;
+    int ysize;
+    int source_nums;
+    int init_steps;
+    const char * reward;
+    int special_reward;
+    int max_tick;
+    int num_threads;
+    double scales[3] = {1.0, 1.0, 1.0};
+    PyObject* dtype_arg = NULL;
+    unsigned int seed = next_seed;
+
+    if (!PyArg_ParseTuple(args, "iiiiispii|(ddd)OI",
+                          &num_envs,
+                          &xsize,
+                          &ysize,
+                          &source_nums,
+                          &init_steps,
+                          &reward,
+                          &special_reward,
+                          &max_tick,
+                          &num_threads,
+                          &scales[0], &scales[1], &scales[2],
+                          &dtype_arg,
+                          &seed))
+        return NULL;
+    if (num_envs <= 0 || num_threads <= 0){
+        PyErr_SetString(PyExc_ValueError, "num_envs and num_threads must be positive");
+        return NULL;
+    }
+    int type_num = NPY_FLOAT32;
+    if (dtype_arg != NULL && dtype_arg != Py_None){
+        PyArray_Descr* descr;
+        if (!PyArray_DescrConverter(dtype_arg, &descr))
+            return NULL;
+        type_num = descr -> type_num;
+        Py_DECREF(descr);
+    }
+    if (type_num != NPY_FLOAT32 && type_num != NPY_UINT8){
+        PyErr_SetString(PyExc_TypeError, "dtype must be float32 or uint8");
+        return NULL;
+    }
+    next_seed += num_envs;
+
+    VecController * vec;
+    Py_BEGIN_ALLOW_THREADS
+    vec = new VecController(num_envs, xsize, ysize, source_nums, init_steps, reward[0], special_reward, max_tick,
+                            seed, num_threads, scales, type_num == NPY_UINT8);
+    Py_END_ALLOW_THREADS
+
+    PyObject* vecCapsule = PyCapsule_New((void *)vec, "VecControllerPtr", release_vec);
+    if (vecCapsule == NULL){
+        delete vec;
+        return NULL;
+    }
+    return vecCapsule;
+}
+
+PyObject* vec_step(PyObject* self, PyObject* args){
+    TraceScope scope("vec_step");
+    PyObject* vecCapsule;
+    PyObject* doses_arg;
+    PyObject* rest_arg;
+
+    if (!PyArg_ParseTuple(args, "OOO",
+                          &vecCapsule,
+                          &doses_arg,
+                          &rest_arg))
+        return NULL;
+
+    VecController* vec = get_vec(vecCapsule);
+    if (vec == NULL)
+        return NULL;
+    PyArrayObject* doses = (PyArrayObject*)PyArray_FROM_OTF(doses_arg, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY);
+    PyArrayObject* rest_hours = (PyArrayObject*)PyArray_FROM_OTF(rest_arg, NPY_INT, NPY_ARRAY_IN_ARRAY);
+    if (doses == NULL || rest_hours == NULL){
+        Py_XDECREF(doses);
+        Py_XDECREF(rest_hours);
+        return NULL;
+    }
+    if (PyArray_SIZE(doses) != vec -> num_envs || PyArray_SIZE(rest_hours) != vec -> num_envs){
+        Py_DECREF(doses);
+        Py_DECREF(rest_hours);
+        PyErr_SetString(PyExc_ValueError, "doses and rest_hours must have one entry per environment");
+        return NULL;
+    }
+
+    npy_intp env_dims[1] = {vec -> num_envs};
+    PyObject* observations = new_vec_observations(vec);
+    PyObject* rewards = PyArray_SimpleNew(1, env_dims, NPY_DOUBLE);
+    PyObject* terminals = PyArray_SimpleNew(1, env_dims, NPY_BOOL);
+    if (observations == NULL || rewards == NULL || terminals == NULL){
+        Py_XDECREF(observations);
+        Py_XDECREF(rewards);
+        Py_XDECREF(terminals);
+        Py_DECREF(doses);
+        Py_DECREF(rest_hours);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    vec -> step((double *) PyArray_DATA(doses), (int *) PyArray_DATA(rest_hours),
+                PyArray_DATA((PyArrayObject *) observations),
+                (double *) PyArray_DATA((PyArrayObject *) rewards),
+                (bool *) PyArray_DATA((PyArrayObject *) terminals));
+    Py_END_ALLOW_THREADS
+
+    Py_DECREF(doses);
+    Py_DECREF(rest_hours);
+    return Py_BuildValue("NNN", observations, rewards, terminals);
+}
+
+PyObject* vec_reset(PyObject* self, PyObject* args){
+    TraceScope scope("vec_reset");
+    PyObject* vecCapsule;
+    PyObject* indices_arg;
+
+    if (!PyArg_ParseTuple(args, "OO",
+                          &vecCapsule,
+                          &indices_arg))
+        return NULL;
+
+    VecController* vec = get_vec(vecCapsule);
+    if (vec == NULL)
+        return NULL;
+    PyArrayObject* indices = (PyArrayObject*)PyArray_FROM_OTF(indices_arg, NPY_INT, NPY_ARRAY_IN_ARRAY);
+    if (indices == NULL)
+        return NULL;
+    int count = (int) PyArray_SIZE(indices);
+    int * index_data = (int *) PyArray_DATA(indices);
+    std::vector<bool> seen(vec -> num_envs, false); // The environments are reset in parallel, each at most once
+    for (int k = 0; k < count; k++){
+        if (index_data[k] < 0 || index_data[k] >= vec -> num_envs){
+            Py_DECREF(indices);
+            PyErr_SetString(PyExc_IndexError, "environment index out of range");
+            return NULL;
+        }
+        if (seen[index_data[k]]){
+            Py_DECREF(indices);
+            PyErr_SetString(PyExc_ValueError, "environment indices must be distinct");
+            return NULL;
+        }
+        seen[index_data[k]] = true;
+    }
+
+    PyObject* observations = new_vec_observations(vec);
+    if (observations == NULL){
+        Py_DECREF(indices);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    vec -> reset(index_data, count, PyArray_DATA((PyArrayObject *) observations));
+    Py_END_ALLOW_THREADS
+
+    Py_DECREF(indices);
+    return observations;
 }
 
+PyObject* vec_observe(PyObject* self, PyObject* args){
+    TraceScope scope("vec_observe");
+    PyObject* vecCapsule;
+
+    if (!PyArg_ParseTuple(args, "O",
+                          &vecCapsule))
+        return NULL;
+
+    VecController* vec = get_vec(vecCapsule);
+    if (vec == NULL)
+        return NULL;
+    PyObject* observations = new_vec_observations(vec);
+    if (observations == NULL)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    vec -> observe(PyArray_DATA((PyArrayObject *) observations));
+    Py_END_ALLOW_THREADS
+
+    return observations;
+}
+
+PyObject* delete_vec_controller(PyObject* self, PyObject* args){
+    PyObject* vecCapsule;
+    if (!PyArg_ParseTuple(args, "O",
+                          &vecCapsule))
+        return NULL;
+
+    void * vec = PyCapsule_GetPointer(vecCapsule, "VecControllerPtr");
+    if (vec == NULL)
+        return NULL;
+    if (vec != &deleted_vec){ // Deleting twice does nothing
+        delete (VecController *) vec;
+        PyCapsule_SetPointer(vecCapsule, &deleted_vec);
+    }
+
+    Py_RETURN_NONE;
+}
 
 
 PyMethodDef cppCellModelFunctions[] =
@@ -400,10 +1203,62 @@ PyMethodDef cppCellModelFunctions[] =
       controller_constructor_oar, METH_VARARGS,
      "Create Controller with oar zone"},
 
+    {"controller_snapshot",
+      controller_snapshot, METH_VARARGS,
+     "Copy of a Controller, to be kept as the starting point of later episodes"},
+
+    {"reset_from",
+      reset_from, METH_VARARGS,
+     "New Controller copied from a snapshot, with fresh random streams unless reseed is False"},
+
+    {"save_checkpoint",
+      save_checkpoint, METH_VARARGS,
+     "Save the full state of a Controller to a binary checkpoint file"},
+
+    {"load_checkpoint",
+      load_checkpoint, METH_VARARGS,
+     "New Controller loaded from a checkpoint file, with fresh random streams if reseed is True"},
+
+    {"save_checkpoint_library",
+      save_checkpoint_library, METH_VARARGS,
+     "Save the checkpoints of a list of Controllers in a single library file"},
+
+    {"open_checkpoint_library",
+      open_checkpoint_library, METH_VARARGS,
+     "Map a checkpoint library in memory (read-only, shared between processes)"},
+
+    {"library_size",
+      library_size, METH_VARARGS,
+     "Number of checkpoints in a library"},
+
+    {"library_instantiate",
+      library_instantiate, METH_VARARGS,
+     "New Controller from a checkpoint of a library, with fresh random streams if reseed is True"},
+
+    {"close_checkpoint_library",
+      close_checkpoint_library, METH_VARARGS,
+     "Unmap a checkpoint library, after which using it raises ValueError. Closing it again does nothing"},
+
     {"go",
       go, METH_VARARGS,
      "Simulate a number of steps"},
 
+    {"go_async",
+      go_async, METH_VARARGS,
+     "Start simulating a number of steps on another thread and return a handle on the step"},
+
+    {"step_done",
+      step_done, METH_VARARGS,
+     "Whether the step started by go_async is over"},
+
+    {"step_wait",
+      step_wait, METH_VARARGS,
+     "Wait for the step started by go_async to be over"},
+
+    {"set_cycle_threads",
+      set_cycle_threads, METH_VARARGS,
+     "Number of threads (and optionally tile size) used to advance the cells of a controller"},
+
     {"irradiate",
       irradiate, METH_VARARGS,
      "Irradiate the tumor with a certain dose"},
@@ -425,16 +1280,16 @@ PyMethodDef cppCellModelFunctions[] =
      "Delete Controller"},
 
     {"HCellCount",
-      (PyCFunction)HCellCount, METH_NOARGS,
-     "Number of healthy cells"},
+      HCellCount, METH_VARARGS,
+     "Number of healthy cells in the given controller"},
     
     {"CCellCount",
-      (PyCFunction)CCellCount, METH_NOARGS,
-     "Number of cancer cells"},
+      CCellCount, METH_VARARGS,
+     "Number of cancer cells in the given controller"},
 
     {"OARCellCount",
-      (PyCFunction)OARCellCount, METH_NOARGS,
-     "Number of cancer cells"},
+      OARCellCount, METH_VARARGS,
+     "Number of OAR cells in the given controller"},
 
     {"observeDensity",
       observeDensity, METH_VARARGS,
@@ -442,15 +1297,22 @@ PyMethodDef cppCellModelFunctions[] =
     
     {"observeGlucose",
       observeGlucose, METH_VARARGS,
-     "Observation of glucose"},
+     "Read-only view of the glucose field, or a copy of it if copy is True"},
 
      {"observeOxygen",
       observeOxygen, METH_VARARGS,
-     "Observation of oxygen"},
+     "Read-only view of the oxygen field, or a copy of it if copy is True"},
+
+     {"observeDose",
+      observeDose, METH_VARARGS,
+     "Read-only view of the dose received by each pixel during the last irradiation, or a copy of it if copy is True"},
 
      {"observeSegmentation",
       observeSegmentation, METH_VARARGS,
      "Observation of pixel types"},
+     {"observeState",
+      observeState, METH_VARARGS,
+     "Scaled segmentation, glucose and oxygen as a (xsize, ysize, 3) float32 or uint8 array, written into out if given"},
      {"tumor_radius",
       tumor_radius, METH_VARARGS,
      "Observation of oxygen"},
@@ -463,6 +1325,46 @@ PyMethodDef cppCellModelFunctions[] =
      {"controllerTick",
       controllerTick, METH_VARARGS,
      "Number of ticks for current controller"},
+     {"stats",
+      stats, METH_VARARGS,
+     "Time spent in each phase of the simulation and counts of cell events since the controller was created or the "
+     "statistics reset, as a dict, then reset them if reset is True"},
+     {"trace_start",
+      trace_start, METH_VARARGS,
+     "Start recording the timeline of the simulation phases and binding calls, keeping the last capacity events"},
+     {"trace_stop",
+      trace_stop, METH_VARARGS,
+     "Stop recording the timeline, keeping the events for trace_dump"},
+     {"trace_begin",
+      trace_begin, METH_VARARGS,
+     "Mark the beginning of a named scope of the Python code in the timeline"},
+     {"trace_end",
+      trace_end, METH_VARARGS,
+     "Mark the end of a named scope of the Python code in the timeline"},
+     {"trace_dump",
+      trace_dump, METH_VARARGS,
+     "Write the recorded timeline to a Chrome trace JSON file, returns the number of events"},
+
+    {"vec_constructor",
+      vec_constructor, METH_VARARGS,
+     "Create a batch of independent controllers stepped together, observed as by observeState with the given scales "
+     "and dtype"},
+
+    {"vec_step",
+      vec_step, METH_VARARGS,
+     "Irradiate and rest every controller of the batch, returns (observations, rewards, terminals)"},
+
+    {"vec_reset",
+      vec_reset, METH_VARARGS,
+     "Start a new episode for the given controllers of the batch, returns the observations"},
+
+    {"vec_observe",
+      vec_observe, METH_VARARGS,
+     "Observation of every controller of the batch as a (K, xsize, ysize, 3) array"},
+
+    {"delete_vec_controller",
+      delete_vec_controller, METH_VARARGS,
+     "Delete a batch of controllers, after which using it raises ValueError. Deleting it again does nothing"},
 
     {NULL, NULL, 0, NULL} 
 };
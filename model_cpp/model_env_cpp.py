@@ -17,7 +17,8 @@ from deer.base_classes import Environment
 class CellEnvironment(Environment):
     """Environment that the reinforcement learning agent uses to interact with the simulation."""
 
-    def __init__(self, obs_type, resize, reward, action_type, special_reward):
+    def __init__(self, obs_type, resize, reward, action_type, special_reward, snapshot_pool=0,
+                 checkpoint_library=None):
         """Constructor of the environment
 
         Parameters:
@@ -27,9 +28,18 @@ class CellEnvironment(Environment):
                  cells while miniizing damage to healthy tissue and 'oar' to minimize damage to the Organ At Risk
         action_type : 'DQN' means that we have a discrete action domain and 'DDPG' means that it is continuous
         special_reward : True if the agent should receive a special reward at the end of the episode.
+        snapshot_pool : Number of simulations grown for 350 hours once and kept as snapshots, each episode then starts
+                        from a copy of one of them with fresh random streams instead of growing a new tumor (0 to
+                        always grow a new one)
+        checkpoint_library : Path of a library of checkpoints saved with cppCellModel.save_checkpoint_library, each
+                             episode then starts from a random checkpoint of the library with fresh random streams
         """
+        self.snapshots = [cppCellModel.controller_constructor(50, 50, 100, 350) for _ in range(snapshot_pool)]
+        self.library = None
+        if checkpoint_library is not None:
+            self.library = cppCellModel.open_checkpoint_library(checkpoint_library)
         self.controller_capsule = cppCellModel.controller_constructor(50, 50, 100, 350)
-        self.init_hcell_count = cppCellModel.HCellCount()
+        self.init_hcell_count = cppCellModel.HCellCount(self.controller_capsule)
         self.obs_type = obs_type
         self.resize = resize
         self.reward = reward
@@ -50,14 +60,9 @@ class CellEnvironment(Environment):
     def init_dataset(self):
         self.dataset = [[], [], []]
 
-    def add_radiation(self, dose, radius, center_x, center_y):
-        if dose == 0:
-            return
-        multiplicator = get_multiplicator(dose, radius)
-        for x in range(50):
-            for y in range(50):
-                dist = math.sqrt((center_x - x)**2 + (center_y - y)**2)
-                self.dose_map[x, y] += scale(radius, dist, multiplicator)
+    def add_radiation(self):
+        # Dose received by each pixel during the last irradiation, as computed by the simulation
+        self.dose_map += cppCellModel.observeDose(self.controller_capsule)
 
     def show_dose_map(self):
         pos = plt.imshow(self.dose_map, cmap=mcol.LinearSegmentedColormap.from_list("MyCmapName",[[0,0,0.6],"r"]))
@@ -66,9 +71,15 @@ class CellEnvironment(Environment):
 
     def reset(self, mode):
         cppCellModel.delete_controller(self.controller_capsule)
-        self.controller_capsule = cppCellModel.controller_constructor(50, 50, 100, 350)
-        self.init_hcell_count = cppCellModel.HCellCount()
-        self.init_ccell_count = cppCellModel.CCellCount()
+        if self.library is not None:
+            index = random.randrange(cppCellModel.library_size(self.library))
+            self.controller_capsule = cppCellModel.library_instantiate(self.library, index, True)
+        elif self.snapshots:
+            self.controller_capsule = cppCellModel.reset_from(random.choice(self.snapshots))
+        else:
+            self.controller_capsule = cppCellModel.controller_constructor(50, 50, 100, 350)
+        self.init_hcell_count = cppCellModel.HCellCount(self.controller_capsule)
+        self.init_ccell_count = cppCellModel.CCellCount(self.controller_capsule)
         if mode == -1:
             self.verbose = False
         else :
@@ -86,27 +97,25 @@ class CellEnvironment(Environment):
     def act(self, action):
         dose = 1 + action / 2 if self.action_type == 'DQN' else action[0] * 4 + 1
         rest = 24 if self.action_type == 'DQN' else int(round(action[1] * 60 + 12))
-        if self.dose_map is not None:
-            tumor_radius = cppCellModel.tumor_radius(self.controller_capsule)
-        pre_hcell = cppCellModel.HCellCount()
-        pre_ccell = cppCellModel.CCellCount()
+        pre_hcell = cppCellModel.HCellCount(self.controller_capsule)
+        pre_ccell = cppCellModel.CCellCount(self.controller_capsule)
         self.total_dose += dose
         self.num_doses += 1 if dose > 0 else 0
         cppCellModel.irradiate(self.controller_capsule, dose)
-        self.radiation_h_killed += (pre_hcell - cppCellModel.HCellCount())
+        self.radiation_h_killed += (pre_hcell - cppCellModel.HCellCount(self.controller_capsule))
         if self.dataset is not None:
             self.dataset[0].append(cppCellModel.controllerTick(self.controller_capsule) - 350)
-            self.dataset[1].append((pre_ccell, cppCellModel.CCellCount()))
+            self.dataset[1].append((pre_ccell, cppCellModel.CCellCount(self.controller_capsule)))
             self.dataset[2].append(dose)
         if self.dose_map is not None:
-            self.add_radiation(dose, tumor_radius, cppCellModel.get_center_x(self.controller_capsule), cppCellModel.get_center_y(self.controller_capsule))
+            self.add_radiation()
             self.dose_maps.append((cppCellModel.controllerTick(self.controller_capsule) - 350, np.copy(self.dose_map)))
             self.tumor_images.append((cppCellModel.controllerTick(self.controller_capsule) - 350, cppCellModel.observeDensity(self.controller_capsule)))
-        p_hcell = cppCellModel.HCellCount()
-        p_ccell = cppCellModel.CCellCount()
+        p_hcell = cppCellModel.HCellCount(self.controller_capsule)
+        p_ccell = cppCellModel.CCellCount(self.controller_capsule)
         cppCellModel.go(self.controller_capsule, rest)
-        post_hcell = cppCellModel.HCellCount()
-        post_ccell = cppCellModel.CCellCount()
+        post_hcell = cppCellModel.HCellCount(self.controller_capsule)
+        post_ccell = cppCellModel.CCellCount(self.controller_capsule)
         self.rest_c_gained += (post_ccell - p_ccell)
         reward = self.adjust_reward(dose, rest, pre_ccell, p_ccell, post_ccell, pre_hcell, p_hcell, post_hcell)
         if self.verbose:
@@ -115,7 +124,7 @@ class CellEnvironment(Environment):
         return reward, dose, rest, pre_hcell-p_hcell
 
     def surviving_fraction(self):
-        return cppCellModel.HCellCount() / self.init_hcell_count
+        return cppCellModel.HCellCount(self.controller_capsule) / self.init_hcell_count
 
     def adjust_reward(self, dose,rest, pre_ccell, p_ccell, post_ccell, pre_hcell, p_hcell, post_hcell):
 
@@ -128,10 +137,10 @@ class CellEnvironment(Environment):
                
             else:
                 if self.reward == 'dose':
-                    return 0.5 - (self.init_hcell_count - cppCellModel.HCellCount()) / 3000 
+                    return 0.5 - (self.init_hcell_count - cppCellModel.HCellCount(self.controller_capsule)) / 3000 
                     
                 else:
-                    return 0.5 - (self.init_hcell_count - cppCellModel.HCellCount()) / 3000
+                    return 0.5 - (self.init_hcell_count - cppCellModel.HCellCount(self.controller_capsule)) / 3000
         else:
             if self.reward == 'dose' or self.reward == 'oar':
                 return - dose / 200 + (ccell_killed - 5 * hcells_lost)/100000
@@ -140,12 +149,12 @@ class CellEnvironment(Environment):
                 return (ccell_killed - 5 * hcells_lost)/100000
 
     def inTerminalState(self):
-        if cppCellModel.CCellCount() <= 0 :
+        if cppCellModel.CCellCount(self.controller_capsule) <= 0 :
             if self.verbose:
                 print("Cancer wins")        
             self.end_type = 'W'
             return True, self.end_type
-        elif cppCellModel.HCellCount() < 10:
+        elif cppCellModel.HCellCount(self.controller_capsule) < 10:
             if self.verbose:
                 print("Cancer wins")
             self.end_type = "L"
@@ -179,7 +188,7 @@ class CellEnvironment(Environment):
 
     def observe(self):
         if self.obs_type == 'scalars':
-            return [cppCellModel.controllerTick(self.controller_capsule) / 2000, cppCellModel.HCellCount() / 100000, cppCellModel.CCellCount()/ 50000]
+            return [cppCellModel.controllerTick(self.controller_capsule) / 2000, cppCellModel.HCellCount(self.controller_capsule) / 100000, cppCellModel.CCellCount(self.controller_capsule)/ 50000]
         else:
             if self.obs_type == 'densities':
                 cells = (np.array(cppCellModel.observeDensity(self.controller_capsule), dtype=np.float32)) / 100.0
@@ -189,9 +198,60 @@ class CellEnvironment(Environment):
                 cells = cv2.resize(cells, dsize=(25,25), interpolation=cv2.INTER_CUBIC)
             return [cells]
 
+    def observe_state(self, scales=(1.0, 1.0, 1.0), dtype=np.float32, out=None):
+        """(50, 50, 3) array of the segmentation (from 0 to 1), glucose and oxygen of each pixel, multiplied by scales.
+        If out is given, it is filled in place and returned."""
+        return cppCellModel.observeState(self.controller_capsule, tuple(scales), dtype, out)
+
     def summarizePerformance(self, test_data_set, *args, **kwargs):
         print(test_data_set)
 
+
+class VecCellEnvironment:
+    """Batch of independent environments stepped together in C++, on a thread pool and without holding the GIL.
+
+    Follows the protocol of CellEnvironment with the continuous ('DDPG') action space: each row of actions is turned
+    into a dose and a number of rest hours, and the observations are (num_envs, 50, 50, 3) arrays holding the state of
+    each environment as given by CellEnvironment.observe_state, so that the same policy can be fed from both.
+    """
+
+    def __init__(self, num_envs, reward, special_reward, num_threads, seed=None, scales=(1.0, 1.0, 1.0),
+                 dtype=np.float32):
+        """Constructor of the batch
+
+        Parameters:
+        num_envs : Number of environments in the batch
+        reward : Type of reward function used ('dose', 'killed' or 'oar', see CellEnvironment)
+        special_reward : True if the agent should receive a special reward at the end of the episode.
+        num_threads : Number of threads used to advance the environments
+        seed : Seed of the first environment, the others use the following seeds
+        scales, dtype : Scales of the channels and type (float32 or uint8) of the observations, see
+                        CellEnvironment.observe_state
+        """
+        args = (num_envs, 50, 50, 100, 350, reward, special_reward, 1200, num_threads, tuple(scales), dtype)
+        if seed is not None:
+            args += (seed,)
+        self.vec_capsule = cppCellModel.vec_constructor(*args)
+        self.num_envs = num_envs
+
+    def reset(self, indices=None):
+        if indices is None:
+            indices = range(self.num_envs)
+        return cppCellModel.vec_reset(self.vec_capsule, np.asarray(indices, dtype=np.int32))
+
+    def observe(self):
+        return cppCellModel.vec_observe(self.vec_capsule)
+
+    def act(self, actions):
+        actions = np.asarray(actions, dtype=float).reshape((self.num_envs, 2))
+        doses = actions[:, 0] * 4 + 1
+        rest = np.round(actions[:, 1] * 60 + 12).astype(np.int32)
+        observations, rewards, terminals = cppCellModel.vec_step(self.vec_capsule, doses, rest)
+        return observations, rewards, terminals, doses, rest
+
+    def end(self):
+        cppCellModel.delete_vec_controller(self.vec_capsule)
+
 def transform(head):
     to_ret = np.zeros(shape=(head.shape[0], head.shape[1], 3), dtype=np.int)
     for i in range(head.shape[0]):
@@ -234,21 +294,21 @@ def tcp_test(num):
     for i in range(num):
         print(i)
         controller = cppCellModel.controller_constructor(50, 50, 100, 350)
-        counts.append(cppCellModel.HCellCount())
+        counts.append(cppCellModel.HCellCount(controller))
         for i in range(35):
-            #print("Before", cppCellModel.HCellCount(), cppCellModel.CCellCount())
+            #print("Before", cppCellModel.HCellCount(controller), cppCellModel.CCellCount(controller))
             cppCellModel.irradiate(controller, 2)
-            ##print("After", cppCellModel.HCellCount(), cppCellModel.CCellCount())
+            ##print("After", cppCellModel.HCellCount(controller), cppCellModel.CCellCount(controller))
             cppCellModel.go(controller, 24)
-            if cppCellModel.CCellCount() == 0:
+            if cppCellModel.CCellCount(controller) == 0:
                 steps.append(i + 1)
                 break
-        count = cppCellModel.CCellCount()
+        count = cppCellModel.CCellCount(controller)
         if count > 10:
             count_failed += 1
         elif count == 0:
             count_success += 1
-        counts[-1] /= cppCellModel.HCellCount()
+        counts[-1] /= cppCellModel.HCellCount(controller)
         cppCellModel.delete_controller(controller)
     print("Percentage of full recovs :", (100*count_success)/ num)
     print("Percentage of almost recovs :", (100*(num - count_failed))/ num)
@@ -261,7 +321,7 @@ def _test():
         controller = cppCellModel.controller_constructor(50, 50, 100, 350)
         cppCellModel.irradiate(controller, 2)
         cppCellModel.go(controller, 24)
-        print(cppCellModel.CCellCount())
+        print(cppCellModel.CCellCount(controller))
         cppCellModel.delete_controller(controller)
 
 def save_tumor_image(data, tick):
@@ -283,48 +343,48 @@ if __name__ == '__main__':
     controller = cppCellModel.controller_constructor(50, 50, 100, 0)
     cppCellModel.go(controller, 350)
     for i in range(35):
-        a = cppCellModel.CCellCount()
+        a = cppCellModel.CCellCount(controller)
         cppCellModel.irradiate(controller, 2)
-        b = cppCellModel.CCellCount()
+        b = cppCellModel.CCellCount(controller)
         cppCellModel.go(controller, 24)
-        c= cppCellModel.CCellCount()
+        c= cppCellModel.CCellCount(controller)
         print(b / a, c / b)
     cppCellModel.delete_controller(controller)
     '''
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 0)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 50)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 100)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 150)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 200)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 250)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     save_tumor_image(transform_densities(cppCellModel.observeGrid(controller)), 300)
     for i in range(50):
         ticks.append(cppCellModel.controllerTick(controller))
-        cancer_cells.append(cppCellModel.CCellCount())
+        cancer_cells.append(cppCellModel.CCellCount(controller))
         cppCellModel.go(controller, 1)
     '''
     #cppCellModel.go(controller, 550)
@@ -361,9 +421,9 @@ if __name__ == '__main__':
     oxygen_plot.imshow(cppCellModel.observeOxygen(controller))
     cell_plot.imshow(cppCellModel.observeGrid(controller))
     ccount_ticks.append(cppCellModel.controllerTick(controller))
-    ccount_vals.append(cppCellModel.CCellCount())
+    ccount_vals.append(cppCellModel.CCellCount(controller))
     cancer_count_plot.plot(ccount_ticks, ccount_vals)
-    print(cppCellModel.CCellCount())
+    print(cppCellModel.CCellCount(controller))
     for i in range(200):
         cppCellModel.go(controller, 12)
         if i % 2 == 0:
@@ -373,7 +433,7 @@ if __name__ == '__main__':
         oxygen_plot.imshow(cppCellModel.observeOxygen(controller))
         cell_plot.imshow(transform(cppCellModel.observeType(controller)))
         ccount_ticks.append(cppCellModel.controllerTick(controller))
-        ccount_vals.append(cppCellModel.CCellCount())
+        ccount_vals.append(cppCellModel.CCellCount(controller))
         cancer_count_plot.plot(ccount_ticks, ccount_vals)
         plt.pause(0.02)
 
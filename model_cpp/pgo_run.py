@@ -0,0 +1,10 @@
+# Canonical workload recorded by "make pgo-module": the same 2000 tick treatment as the controller executable
+# (controller_main.cpp), run through the cppCellModel module built with CPPCELLMODEL_BUILD=pgo-generate
+import cppCellModel
+
+controller = cppCellModel.controller_constructor_oar(50, 50, 50, 0, 5, 15, 5, 15, 42)
+for i in range(1, 2001):
+    cppCellModel.go(controller, 1)
+    if i > 400 and i % 24 == 0:
+        cppCellModel.irradiate(controller, 2.0)
+cppCellModel.delete_controller(controller)
@@ -0,0 +1,187 @@
+#ifndef RADIO_RL_PHILOX_H
+#define RADIO_RL_PHILOX_H
+
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+/**
+ * Stream of random numbers drawn from the Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+ * numbers: as easy as 1, 2, 3", 2011)
+ *
+ * Each block of 4 random words is a pure function of a 2 word key and a 4 word counter. The first two words of the
+ * counter are the position of the block in the stream, the last two identify the stream, so that any number of
+ * independent streams can be opened directly from their key and identifiers, without drawing them in sequence.
+ */
+class PhiloxStream {
+public:
+    PhiloxStream();
+    void start(uint32_t key0, uint32_t key1, uint32_t stream0, uint32_t stream1);
+    uint32_t next();
+    double uniform();
+    double normal();
+    void write(std::ostream & out);
+    bool read(std::istream & in);
+    static void block(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]);
+    static double to_uniform(uint32_t high, uint32_t low);
+    static double to_normal(uint32_t high, uint32_t low);
+private:
+    void refill();
+    uint32_t key[2];
+    uint32_t counter[4]; // Counter of the next block to generate
+    uint32_t words[4]; // Last block generated
+    int used; // Number of words of the last block already returned
+};
+
+inline PhiloxStream::PhiloxStream(): words(), used(4) {
+    start(0, 0, 0, 0);
+}
+
+/**
+ * Move to the beginning of a stream
+ *
+ * @param key0 First word of the key
+ * @param key1 Second word of the key
+ * @param stream0 First identifier of the stream
+ * @param stream1 Second identifier of the stream
+ */
+inline void PhiloxStream::start(uint32_t key0, uint32_t key1, uint32_t stream0, uint32_t stream1){
+    key[0] = key0;
+    key[1] = key1;
+    counter[0] = 0;
+    counter[1] = 0;
+    counter[2] = stream0;
+    counter[3] = stream1;
+    used = 4;
+}
+
+/**
+ * Compute the block of 4 random words of a counter, with the 10 rounds of Philox4x32
+ *
+ * @param counter The counter of the block
+ * @param key The key of the generator
+ * @param out Set to the random words
+ */
+inline void PhiloxStream::block(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4]){
+    uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++){
+        uint64_t p0 = (uint64_t) 0xD2511F53u * c0;
+        uint64_t p1 = (uint64_t) 0xCD9E8D57u * c2;
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) p1;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) p0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+/**
+ * Convert two random words to a double uniformly distributed in [0, 1), with 53 random bits
+ */
+inline double PhiloxStream::to_uniform(uint32_t high, uint32_t low){
+    return ((high >> 5) * 67108864.0 + (low >> 6)) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Convert two random words to a draw from the standard normal distribution
+ *
+ * Inverts the normal CDF with the rational approximation of P. J. Acklam (relative error below 1.2e-9): unlike the
+ * Box-Muller or polar methods, the central 95% of the draws need no logarithm, square root or trigonometric function,
+ * and each draw uses a fixed number of words.
+ */
+inline double PhiloxStream::to_normal(uint32_t high, uint32_t low){
+    static const double a[6] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static const double b[5] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                6.680131188771972e+01, -1.328068155288572e+01};
+    static const double c[6] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static const double d[4] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                3.754408661907416e+00};
+    double p = to_uniform(high, low) + 0.5 / 9007199254740992.0; // In (0, 1)
+    if (p > 0.02425 && p < 0.97575){
+        double q = p - 0.5;
+        double r = q * q;
+        return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+               (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1.0);
+    }
+    double q = std::sqrt(-2.0 * std::log(p < 0.5 ? p : 1.0 - p));
+    double x = (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1.0);
+    return p < 0.5 ? x : -x;
+}
+
+/**
+ * Generate the next block of the stream
+ */
+inline void PhiloxStream::refill(){
+    block(counter, key, words);
+    if (++counter[0] == 0)
+        counter[1]++;
+    used = 0;
+}
+
+/**
+ * Draw a uniformly distributed 32 bit word
+ */
+inline uint32_t PhiloxStream::next(){
+    if (used == 4)
+        refill();
+    return words[used++];
+}
+
+/**
+ * Draw uniformly from [0, 1)
+ */
+inline double PhiloxStream::uniform(){
+    uint32_t high = next();
+    return to_uniform(high, next());
+}
+
+/**
+ * Draw from the standard normal distribution
+ */
+inline double PhiloxStream::normal(){
+    uint32_t high = next();
+    return to_normal(high, next());
+}
+
+/**
+ * Write the position of the stream as text, from which read restores it exactly
+ */
+inline void PhiloxStream::write(std::ostream & out){
+    // The last block is regenerated from its counter rather than saved
+    uint32_t block_counter[2] = {counter[0], counter[1]};
+    if (used < 4){
+        if (block_counter[0]-- == 0)
+            block_counter[1]--;
+    }
+    out << key[0] << ' ' << key[1] << ' ' << counter[2] << ' ' << counter[3] << ' ' << block_counter[0] << ' '
+        << block_counter[1] << ' ' << used;
+}
+
+/**
+ * Restore a position written by write
+ *
+ * @return false if the position could not be parsed
+ */
+inline bool PhiloxStream::read(std::istream & in){
+    in >> key[0] >> key[1] >> counter[2] >> counter[3] >> counter[0] >> counter[1] >> used;
+    if (in.fail() || used < 0 || used > 4)
+        return false;
+    if (used < 4){
+        int position = used;
+        refill();
+        used = position;
+    }
+    return true;
+}
+
+#endif //RADIO_RL_PHILOX_H
@@ -0,0 +1,182 @@
+#include "q_table.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char q_table_magic[8] = "RADIOQT";
+static const uint32_t q_table_version = 1;
+
+/**
+ * Constructor of a QTable filled with zeros
+ *
+ * @param cancer_stages Number of stages of the number of cancer cells in the states of the agent
+ * @param healthy_stages Number of stages of the number of healthy cells in the states of the agent
+ * @param actions Number of actions of the agent
+ */
+QTable::QTable(int cancer_stages, int healthy_stages, int actions): cancer_stages(cancer_stages),
+        healthy_stages(healthy_stages), actions(actions), padded_actions(row_stride(actions)),
+        states(cancer_stages * healthy_stages), data(nullptr), mapping(nullptr), mapping_size(0) {
+    row_pointers = new double*[states];
+    make_writable();
+}
+
+QTable::~QTable(){
+    release();
+    delete[] row_pointers;
+}
+
+/**
+ * Free the values of the table, or unmap them
+ */
+void QTable::release(){
+    if (mapping)
+        munmap(mapping, mapping_size);
+    else
+        free(data);
+    mapping = nullptr;
+    mapping_size = 0;
+    data = nullptr;
+}
+
+/**
+ * Point the rows at a block of states * padded_actions values
+ */
+void QTable::point_rows(double * values){
+    data = values;
+    for (int i = 0; i < states; i++)
+        row_pointers[i] = data + (size_t) i * padded_actions;
+}
+
+/**
+ * Return the rows of the table, row i holding the Q-values of the actions in state i
+ *
+ * The pointers stay valid for the whole life of the table, even when its values are mapped or copied.
+ */
+double ** QTable::rows(){
+    return row_pointers;
+}
+
+/**
+ * Return the number of values stored per row, see row_stride
+ */
+int QTable::stride(){
+    return padded_actions;
+}
+
+/**
+ * Return true if the values are read from a file mapped by map
+ */
+bool QTable::mapped(){
+    return mapping != nullptr;
+}
+
+/**
+ * Make sure the values of the table can be written to, copying them from the mapped file if needed
+ *
+ * Allocates zeroed values if the table has none yet.
+ */
+void QTable::make_writable(){
+    if (data && !mapping)
+        return;
+    void * block = nullptr;
+    size_t size = (size_t) states * padded_actions * sizeof(double);
+    if (posix_memalign(&block, 32, std::max(size, sizeof(double))) != 0)
+        throw std::bad_alloc();
+    double * values = (double *) block;
+    if (data)
+        memcpy(values, data, size);
+    else {
+        for (int i = 0; i < states; i++){
+            for (int j = 0; j < padded_actions; j++)
+                values[(size_t) i * padded_actions + j] = j < actions ? 0.0 : -numeric_limits<double>::infinity();
+        }
+    }
+    release();
+    point_rows(values);
+}
+
+/**
+ * Write the table in the binary format read by map: a QTableHeader followed by the rows, padding included
+ *
+ * @param name Path of the file
+ */
+void QTable::save(const std::string & name){
+    QTableHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, q_table_magic, sizeof(header.magic));
+    header.version = q_table_version;
+    header.cancer_stages = (uint32_t) cancer_stages;
+    header.healthy_stages = (uint32_t) healthy_stages;
+    header.actions = (uint32_t) actions;
+    header.stride = (uint32_t) padded_actions;
+    ofstream file(name, ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open file");
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) data, (streamsize) ((size_t) states * padded_actions * sizeof(double)));
+    if (!file)
+        throw std::runtime_error("Could not write file");
+}
+
+/**
+ * Return true if a file starts with the header written by save
+ */
+bool QTable::is_binary(const std::string & name){
+    ifstream file(name, ios::binary);
+    char magic[sizeof(q_table_magic)];
+    file.read(magic, sizeof(magic));
+    return file && memcmp(magic, q_table_magic, sizeof(magic)) == 0;
+}
+
+/**
+ * Map a file written by save read-only in place of the values of the table
+ *
+ * Mapping is immediate whatever the size of the table, and the pages of the file are shared by all the processes
+ * mapping it.
+ *
+ * @param name Path of the file
+ */
+void QTable::map(const std::string & name){
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open file");
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(QTableHeader)){
+        close(fd);
+        throw std::runtime_error("Not a Q-table file");
+    }
+    size_t size = (size_t) info.st_size;
+    void * file = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        throw std::runtime_error("Could not map file");
+    const QTableHeader * header = (const QTableHeader *) file;
+    size_t values = (size_t) states * padded_actions;
+    if (memcmp(header -> magic, q_table_magic, sizeof(q_table_magic)) != 0 || header -> version != q_table_version){
+        munmap(file, size);
+        throw std::runtime_error("Not a Q-table file");
+    }
+    if ((int) header -> cancer_stages != cancer_stages || (int) header -> healthy_stages != healthy_stages ||
+        (int) header -> actions != actions || (int) header -> stride != padded_actions){
+        munmap(file, size);
+        throw std::runtime_error("Parameters do not match");
+    }
+    if (size != sizeof(QTableHeader) + values * sizeof(double)){
+        munmap(file, size);
+        throw std::runtime_error("Truncated Q-table file");
+    }
+    release();
+    mapping = file;
+    mapping_size = size;
+    point_rows((double *) ((char *) file + sizeof(QTableHeader)));
+}
@@ -0,0 +1,120 @@
+#ifndef RADIO_RL_Q_TABLE_H
+#define RADIO_RL_Q_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * Q-values of a TabularAgent, one row of actions per state, held in a single aligned block
+ *
+ * Rows are padded to a multiple of 4 values (32 bytes) with -infinity, so that max and argmax can scan them with full
+ * vectors. The table can be saved in a binary format (see save) whose values have the same layout as in memory, so
+ * that it can be mapped read-only into any number of processes instead of being parsed (see map): the mapping is only
+ * copied to private memory if the table is written to (see make_writable).
+ */
+class QTable {
+public:
+    QTable(int cancer_stages, int healthy_stages, int actions);
+    ~QTable();
+    double ** rows();
+    int stride();
+    bool mapped();
+    void make_writable();
+    void save(const std::string & name);
+    void map(const std::string & name);
+    static bool is_binary(const std::string & name);
+    static int row_stride(int actions);
+    static double max(const double * row, int stride);
+    static int argmax(const double * row, int stride);
+private:
+    int cancer_stages;
+    int healthy_stages;
+    int actions;
+    int padded_actions;
+    int states;
+    double * data; // states * padded_actions values, owned by the table or pointing into mapping
+    double ** row_pointers; // Pointers to the rows of data
+    void * mapping; // File mapped by map, nullptr if data is owned
+    size_t mapping_size;
+    void point_rows(double * values);
+    void release();
+};
+
+/*
+ * Header of the binary files written by QTable::save, followed by the rows of the table
+ */
+struct QTableHeader {
+    char magic[8]; // "RADIOQT" and a terminating zero
+    uint32_t version;
+    uint32_t cancer_stages;
+    uint32_t healthy_stages;
+    uint32_t actions;
+    uint32_t stride; // Values per row in the file, including the padding
+    uint32_t reserved[9]; // Zero, bringing the header to 64 bytes so that the rows stay aligned
+};
+
+/**
+ * Number of values stored per row for a number of actions
+ */
+inline int QTable::row_stride(int actions){
+    return (actions + 3) / 4 * 4;
+}
+
+/**
+ * Largest value of a row
+ *
+ * @param row A row of a QTable, aligned on 32 bytes
+ * @param stride Number of values of the row, including the padding, see row_stride
+ */
+inline double QTable::max(const double * row, int stride){
+#if defined(__AVX__)
+    __m256d best = _mm256_load_pd(row);
+    for (int i = 4; i < stride; i += 4)
+        best = _mm256_max_pd(best, _mm256_load_pd(row + i));
+    __m128d half = _mm_max_pd(_mm256_castpd256_pd128(best), _mm256_extractf128_pd(best, 1));
+    return _mm_cvtsd_f64(_mm_max_sd(half, _mm_unpackhi_pd(half, half)));
+#elif defined(__SSE2__)
+    __m128d best = _mm_load_pd(row);
+    for (int i = 2; i < stride; i += 2)
+        best = _mm_max_pd(best, _mm_load_pd(row + i));
+    return _mm_cvtsd_f64(_mm_max_sd(best, _mm_unpackhi_pd(best, best)));
+#else
+    double best = row[0];
+    for (int i = 1; i < stride; i++)
+        best = row[i] > best ? row[i] : best;
+    return best;
+#endif
+}
+
+/**
+ * Index of the first occurrence of the largest value of a row
+ *
+ * @param row A row of a QTable, aligned on 32 bytes
+ * @param stride Number of values of the row, including the padding, see row_stride
+ */
+inline int QTable::argmax(const double * row, int stride){
+    double best = max(row, stride);
+#if defined(__SSE2__) || defined(__AVX__)
+    __m128d target = _mm_set1_pd(best);
+    for (int i = 0; i < stride; i += 2){
+        int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_load_pd(row + i), target));
+        if (mask)
+            return i + ((mask & 1) ? 0 : 1);
+    }
+    return 0;
+#else
+    for (int i = 0; i < stride; i++){
+        if (row[i] == best)
+            return i;
+    }
+    return 0;
+#endif
+}
+
+#endif //RADIO_RL_Q_TABLE_H
@@ -1,14 +1,15 @@
 #include "scalar_model.h"
+#include "cell_kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
 #include <stdlib.h>
 #include <math.h>
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <random>
+#include <thread>
 
 using namespace std;
-default_random_engine generator2(5);
-uniform_real_distribution<double> uni_distribution2(0.0, 1.0);
 
 
 /**
@@ -17,8 +18,10 @@ uniform_real_distribution<double> uni_distribution2(0.0, 1.0);
   * The scalar model contains all the cells and sources of the 2D model inside a single pixel
   * The constructor doesn't actually create the simuation as the agent will always first call reset() on the scalar model.
   *
+  * @param reward The type of reward returned to the agent
+  * @param seed The seed of the random streams of the simulation
   */
-ScalarModel::ScalarModel(char reward): reward(reward), cancer_cells(nullptr), healthy_cells(nullptr), time(0), glucose(0.0), oxygen(0.0), end_type('0'), init_hcell_count(0){
+ScalarModel::ScalarModel(char reward, unsigned int seed): end_type('0'), reward(reward), ctx(seed), cancer_cells(nullptr), healthy_cells(nullptr), cohorts(nullptr), time(0), glucose(0.0), oxygen(0.0), init_hcell_count(0){
 }
 
 /**
@@ -28,6 +31,31 @@ ScalarModel::ScalarModel(char reward): reward(reward), cancer_cells(nullptr), he
 ScalarModel::~ScalarModel(){
     delete cancer_cells;
     delete healthy_cells;
+    delete cohorts;
+}
+
+/**
+  * Choose whether the cells are simulated one by one or as cohorts of identical cells (see CohortPopulation)
+  *
+  * The cohorts give statistically equivalent trajectories at a cost that does not depend on the number of cells. The
+  * change takes effect from the next call to reset.
+  *
+  * @param enabled true for the cohorts, false for individual cells
+  */
+void ScalarModel::use_cohorts(bool enabled){
+    if (enabled && !cohorts){
+        cohorts = new CohortPopulation();
+    } else if (!enabled){
+        delete cohorts;
+        cohorts = nullptr;
+    }
+}
+
+/**
+  * Return true if the cells are simulated as cohorts, see use_cohorts
+  */
+bool ScalarModel::uses_cohorts(){
+    return cohorts != nullptr;
 }
 
 /**
@@ -38,18 +66,28 @@ ScalarModel::~ScalarModel(){
 void ScalarModel::reset(){
     delete cancer_cells;
     delete healthy_cells;
-    HealthyCell::count = 0;
-    CancerCell::count = 0;
+    pool.clear();
+    ctx.reset_counts();
     time = 0;
     glucose = 250000.0;
     oxygen = 2500000.0;
-    healthy_cells = new CellList();
-    cancer_cells = new CellList();
+    if (cohorts){
+        cancer_cells = nullptr;
+        healthy_cells = nullptr;
+        cohorts -> clear();
+        cohorts -> add('h', '1', 1000, &ctx);
+        cohorts -> add('c', '1', 1, &ctx);
+        go(350);
+        init_hcell_count = ctx.hcell_count;
+        return;
+    }
+    healthy_cells = new CellList(&pool);
+    cancer_cells = new CellList(&pool);
     for(int i = 0; i < 1000; i++)
-        healthy_cells -> add(new HealthyCell('1'), 'h');
-    cancer_cells -> add(new CancerCell('1'), 'c');
+        healthy_cells -> add(pool.make_cell<HealthyCell>('1', &ctx), 'h');
+    cancer_cells -> add(pool.make_cell<CancerCell>('1', &ctx), 'c');
     go(350);
-    init_hcell_count = HealthyCell::count;
+    init_hcell_count = ctx.hcell_count;
 }
 
 /**
@@ -57,29 +95,33 @@ void ScalarModel::reset(){
  *
  */
 void ScalarModel::cycle_cells(){
-    int hcell_count = HealthyCell::count;
-    int ccell_count = CancerCell::count;
+    if (cohorts){
+        cohorts -> cycle(glucose, oxygen, &ctx);
+        return;
+    }
+    int hcell_count = ctx.hcell_count;
+    int ccell_count = ctx.ccell_count;
     int count = hcell_count + ccell_count;
     CellNode * current_h = healthy_cells -> head;
     CellNode * current_c = cancer_cells -> head;
-    CellNode * current;
     while(hcell_count > 0 || ccell_count > 0){
-        if (rand() % (hcell_count + ccell_count) < ccell_count){
+        // The lists only hold cells of their own type, so the cycle of the final cell classes is called directly
+        cell_cycle_res result;
+        if (ctx.rand_int() % (hcell_count + ccell_count) < ccell_count){
             ccell_count--;
-            current = current_c;
+            result = static_cast<CancerCell *>(current_c -> cell) -> cycle(glucose, oxygen, count / 278, &ctx);
             current_c = current_c -> next;
         } else {
             hcell_count--;
-            current = current_h;
+            result = static_cast<HealthyCell *>(current_h -> cell) -> cycle(glucose, oxygen, count / 278, &ctx);
             current_h = current_h -> next;
         }
-        cell_cycle_res result = current->cell->cycle(glucose, oxygen, count / 278);
         glucose -= result.glucose;
         oxygen -= result.oxygen;
         if (result.new_cell == 'h') //New healthy cell
-            healthy_cells -> add(new HealthyCell('1'), 'h');
+            healthy_cells -> add(pool.make_cell<HealthyCell>('1', &ctx), 'h');
         else if (result.new_cell == 'c') // New cancer cell
-            cancer_cells -> add(new CancerCell('1'), 'c');
+            cancer_cells -> add(pool.make_cell<CancerCell>('1', &ctx), 'c');
     }
     healthy_cells -> deleteDeadAndSort();
     cancer_cells -> deleteDeadAndSort();
@@ -111,15 +153,24 @@ void ScalarModel::go(int i){
  * @param dose The dose of radiation (in grays)
  */
 void ScalarModel::irradiate(int dose){
+    if (cohorts){
+        cohorts -> irradiate(dose, &ctx);
+        return;
+    }
+    // All the cells receive the same dose, so the survival probabilities are computed once per type and stage
+    SurvivalTable<HealthyCell> healthy_survival(dose);
+    SurvivalTable<CancerCell> cancer_survival(dose);
     CellNode * current_h = healthy_cells -> head;
     while(current_h){
-        current_h -> cell -> radiate(dose);
+        double draws[2] = {ctx.uniform(), ctx.uniform()};
+        static_cast<HealthyCell *>(current_h -> cell) -> radiate(healthy_survival, draws, &ctx);
         current_h = current_h -> next;
     }
     healthy_cells -> deleteDeadAndSort();
     CellNode * current_c = cancer_cells -> head;
     while(current_c){
-        current_c -> cell -> radiate(dose);
+        double draws[2] = {ctx.uniform(), ctx.uniform()};
+        static_cast<CancerCell *>(current_c -> cell) -> radiate(cancer_survival, draws, &ctx);
         current_c = current_c -> next;
     }
     cancer_cells -> deleteDeadAndSort();
@@ -132,14 +183,14 @@ void ScalarModel::irradiate(int dose){
   */
 double ScalarModel::act(int action){
     int dose = action + 1;
-    int pre_hcell = HealthyCell::count;
-    int pre_ccell = CancerCell::count;
+    int pre_hcell = ctx.hcell_count;
+    int pre_ccell = ctx.ccell_count;
     irradiate(dose);
-    int m_hcell = HealthyCell::count;
-    int m_ccell = CancerCell::count;
+    int m_hcell = ctx.hcell_count;
+    int m_ccell = ctx.ccell_count;
     go(24);
-    int post_hcell = HealthyCell::count;
-    int post_ccell = CancerCell::count;
+    int post_hcell = ctx.hcell_count;
+    int post_ccell = ctx.ccell_count;
     return adjust_reward(dose, pre_ccell - post_ccell, pre_hcell-min(post_hcell, m_hcell));
 }
 
@@ -154,9 +205,9 @@ double ScalarModel::adjust_reward(int dose, int ccell_killed, int hcells_lost){
             return -1.0;
         } else{
             if (reward == 'd')
-                return - (double) dose / 200.0 + 0.5 + (double) (HealthyCell::count) / 4000.0;
+                return - (double) dose / 200.0 + 0.5 + (double) (ctx.hcell_count) / 4000.0;
             else
-                return 0.5 + (double) (HealthyCell::count) / 4000.0;
+                return 0.5 + (double) (ctx.hcell_count) / 4000.0;
         }
     } else {
         if (reward == 'd' || reward == 'n')
@@ -168,15 +219,29 @@ double ScalarModel::adjust_reward(int dose, int ccell_killed, int hcells_lost){
     }
 }
 
+/**
+  * Return the number of HealthyCells in the simulation
+  */
+int ScalarModel::hcell_count(){
+    return ctx.hcell_count;
+}
+
+/**
+  * Return the number of CancerCells in the simulation
+  */
+int ScalarModel::ccell_count(){
+    return ctx.ccell_count;
+}
+
 /**
   * Returns true if the simulation has reached a terminal state
   *
   */
 bool ScalarModel::inTerminalState(){
-    if (CancerCell::count <= 0){
+    if (ctx.ccell_count <= 0){
         end_type = 'W';
         return true;
-    } else if (HealthyCell::count < 10){
+    } else if (ctx.hcell_count < 10){
         end_type = 'L';
         return true;
     } else if (time > 1550){
@@ -187,11 +252,64 @@ bool ScalarModel::inTerminalState(){
     }
 }
 
-TabularAgent::TabularAgent(ScalarModel * env, int cancer_cell_stages, int healthy_cell_stages, int actions, char state_type): env(env), cancer_cell_stages(cancer_cell_stages), healthy_cell_stages(healthy_cell_stages), actions(actions), state_type(state_type){
-    Q_values = new double*[cancer_cell_stages * healthy_cell_stages];
-    for(int i = 0; i < cancer_cell_stages * healthy_cell_stages; i++){
-        Q_values[i] = new double[actions]();
-    }
+/**
+  * Restart the random streams of the simulation from a new seed
+  *
+  * The cells are left untouched, the new streams being used from the next call to reset.
+  *
+  * @param seed The new seed
+  */
+void ScalarModel::reseed(unsigned int seed){
+    ctx.reseed(seed);
+}
+
+/**
+  * Return the type of reward returned to the agent
+  */
+char ScalarModel::get_reward(){
+    return reward;
+}
+
+TestTotals::TestTotals(): scores(0.0), error(0.0), length(0), squared_length(0), fracs(0), squared_fracs(0), doses(0),
+                          squared_doses(0), wins(0), survival(0.0), squared_survival(0.0) {
+}
+
+/**
+ * Add the sums of another set of episodes to these
+ */
+void TestTotals::add(const TestTotals & other){
+    scores += other.scores;
+    error += other.error;
+    length += other.length;
+    squared_length += other.squared_length;
+    fracs += other.fracs;
+    squared_fracs += other.squared_fracs;
+    doses += other.doses;
+    squared_doses += other.squared_doses;
+    wins += other.wins;
+    survival += other.survival;
+    squared_survival += other.squared_survival;
+}
+
+/**
+ * Derive the seed of a simulation run by a worker from the seed of the agent
+ *
+ * @param seed The seed of the agent, see TabularAgent::set_threads
+ * @param phase 0 for the test episodes, 1 + the number of the call to train for training
+ * @param index The number of the episode when testing, of the worker when training
+ */
+static unsigned int worker_seed(unsigned int seed, unsigned int phase, unsigned int index){
+    uint32_t counter[4] = {index, phase, 0, 0};
+    uint32_t key[2] = {seed, 0};
+    uint32_t words[4];
+    PhiloxStream::block(counter, key, words);
+    return words[0];
+}
+
+TabularAgent::TabularAgent(ScalarModel * env, int cancer_cell_stages, int healthy_cell_stages, int actions, char state_type): env(env), cancer_cell_stages(cancer_cell_stages), healthy_cell_stages(healthy_cell_stages), actions(actions), state_type(state_type), seed(0), train_calls(0), sync_steps(1), pool(nullptr){
+    rng.start(5, 0, 0, 0); // Fixed seed, as the agent used to draw from a global engine seeded with 5
+    Q_table = new QTable(cancer_cell_stages, healthy_cell_stages, actions);
+    Q_values = Q_table -> rows();
     if(state_type == 'o') { //log
         state_helper_hcells = exp(log(3500.0) / ((double) healthy_cell_stages - 2.0));
         state_helper_ccells = exp(log(40000.0) / ((double) cancer_cell_stages - 2.0));
@@ -202,141 +320,233 @@ TabularAgent::TabularAgent(ScalarModel * env, int cancer_cell_stages, int health
 }
 
 TabularAgent::~TabularAgent(){
-    for(int i = 0; i < cancer_cell_stages * healthy_cell_stages; i++){
-        delete[] Q_values[i];
+    clear_workers();
+    delete Q_table;
+}
+
+/**
+ * Delete the simulations and tables of the workers and their threads
+ */
+void TabularAgent::clear_workers(){
+    for (size_t w = 0; w < workers.size(); w++){
+        delete workers[w].env;
+        delete workers[w].Q_table;
+    }
+    workers.clear();
+    delete pool;
+    pool = nullptr;
+}
+
+/**
+ * Choose how many threads run the episodes of train, test and treatment_var
+ *
+ * With a single thread (the default), all the episodes are run one after the other on the simulation given to the
+ * constructor, as they always were. With more threads, each thread owns its own simulation and its own exploration
+ * stream, and simulates the cells the same way as the simulation given to the constructor (see
+ * ScalarModel::use_cohorts):
+ *  - test and treatment_var split the episodes between the threads, episode i running on a simulation reseeded for i,
+ *    so that the results do not depend on the number of threads and successive evaluations see the same episodes. The
+ *    results of each thread are kept apart and added together at the end.
+ *  - train splits the steps between the threads, each training its own copy of the Q-table. Every sync_steps steps,
+ *    the copies are averaged into the table of the agent, from which all the threads start the next round.
+ *
+ * @param num_threads Number of threads, 1 to go back to the serial episodes
+ * @param seed Seed from which the simulations of the threads are seeded
+ * @param sync_steps Steps trained by each thread between two averagings of the tables
+ */
+void TabularAgent::set_threads(int num_threads, unsigned int seed, int sync_steps){
+    clear_workers();
+    this -> seed = seed;
+    this -> sync_steps = max(sync_steps, 1);
+    train_calls = 0;
+    if (num_threads <= 1)
+        return;
+    pool = new ThreadPool(num_threads);
+    workers.resize(num_threads);
+    for (int w = 0; w < num_threads; w++){
+        workers[w].env = new ScalarModel(env -> get_reward(), seed);
+        workers[w].env -> use_cohorts(env -> uses_cohorts());
+        workers[w].Q_table = new QTable(cancer_cell_stages, healthy_cell_stages, actions);
     }
-    delete[] Q_values;
 }
 
-int TabularAgent::state(){
+/**
+ * Return the number of threads running the episodes, see set_threads
+ */
+int TabularAgent::get_threads(){
+    return workers.empty() ? 1 : (int) workers.size();
+}
+
+/**
+ * Reseed the simulation and the exploration stream of a worker for one of the test episodes
+ */
+void TabularAgent::start_episode(AgentWorker & worker, int episode){
+    worker.env -> reseed(worker_seed(seed, 0, (unsigned int) episode));
+    worker.rng.start(seed, (uint32_t) episode, 0, 1);
+}
+
+int TabularAgent::state(ScalarModel * model){
     int hcell_state, ccell_state;
     if(state_type == 'o') { //log
-        ccell_state = min(cancer_cell_stages - 1, (int) ceil(log(CancerCell::count + 1) / log(state_helper_ccells)));
-        hcell_state = min(healthy_cell_stages - 1, (int) ceil(log(max(HealthyCell::count - 8, 1)) / log(state_helper_hcells)));
+        ccell_state = min(cancer_cell_stages - 1, (int) ceil(log(model -> ccell_count() + 1) / log(state_helper_ccells)));
+        hcell_state = min(healthy_cell_stages - 1, (int) ceil(log(max(model -> hcell_count() - 8, 1)) / log(state_helper_hcells)));
     } else{
-        ccell_state = min(cancer_cell_stages - 1, (int) ceil((double) CancerCell::count / (double) state_helper_ccells) );
-        hcell_state = min(healthy_cell_stages - 1, (int) ceil((double)  max(HealthyCell::count - 9, 0) / (double) state_helper_hcells) );
+        ccell_state = min(cancer_cell_stages - 1, (int) ceil((double) model -> ccell_count() / (double) state_helper_ccells) );
+        hcell_state = min(healthy_cell_stages - 1, (int) ceil((double)  max(model -> hcell_count() - 9, 0) / (double) state_helper_hcells) );
     }
     return ccell_state * healthy_cell_stages + hcell_state;
 }
 
-int TabularAgent::choose_action(int state, double epsilon){
-    if(uni_distribution2(generator2) < epsilon) {
-        return rand() % actions;
+int TabularAgent::choose_action(double ** Q, int state, double epsilon, PhiloxStream & stream){
+    if(stream.uniform() < epsilon) {
+        return (int) (stream.next() % actions);
     } else {
-        int max_ind = -1;
-        double max_val = - 999999.0;
-        for(int i = 0; i < actions; i++){
-            if(max_val < Q_values[state][i]) {
-                max_val = Q_values[state][i];
-                max_ind = i;
-            }
-        }
-        return max_ind;
+        int max_ind = QTable::argmax(Q[state], QTable::row_stride(actions));
+        return Q[state][max_ind] > - 999999.0 ? max_ind : -1;
     }
 }
 
 void TabularAgent::train(int steps, double alpha, double epsilon, double disc_factor){
-    env -> reset();
-    while(steps > 0){
-        while (!env->inTerminalState() && steps > 0){
-            int obs = state();
-            int action = choose_action(obs, epsilon);
-            double r = env->act(action);
-            int new_obs = state();
-            double max_val = - 99999.0;
-            for(int i = 0; i < actions; i++){
-                if(Q_values[new_obs][i] > max_val)
-                    max_val = Q_values[new_obs][i];
+    Q_table -> make_writable();
+    if (workers.empty()){
+        env -> reset();
+        train_steps(env, Q_values, rng, steps, alpha, epsilon, disc_factor);
+        return;
+    }
+    int num_workers = (int) workers.size();
+    train_calls++;
+    for (int w = 0; w < num_workers; w++){
+        workers[w].env -> reseed(worker_seed(seed, train_calls, (unsigned int) w));
+        workers[w].env -> reset();
+        workers[w].rng.start(seed, train_calls, (uint32_t) w, 2);
+    }
+    int table_size = cancer_cell_stages * healthy_cell_stages;
+    while (steps > 0){
+        int round = min(steps, sync_steps * num_workers);
+        pool -> run(num_workers, [&](int w){
+            AgentWorker & worker = workers[w];
+            for (int i = 0; i < table_size; i++)
+                std::copy(Q_values[i], Q_values[i] + actions, worker.Q_table -> rows()[i]);
+            int share = round / num_workers + (w < round % num_workers ? 1 : 0);
+            train_steps(worker.env, worker.Q_table -> rows(), worker.rng, share, alpha, epsilon, disc_factor);
+        });
+        // Added in the order of the workers, so that the table does not depend on the scheduling of the threads
+        for (int i = 0; i < table_size; i++){
+            for (int j = 0; j < actions; j++){
+                double sum = 0.0;
+                for (int w = 0; w < num_workers; w++)
+                    sum += workers[w].Q_table -> rows()[i][j];
+                Q_values[i][j] = sum / (double) num_workers;
             }
-            Q_values[obs][action] = (1.0 - alpha) * Q_values[obs][action] + alpha * (r + disc_factor * max_val);
-            steps--;
         }
-        if(steps > 0)
-            env -> reset();
+        steps -= round;
+    }
+}
+
+/**
+ * Train a Q-table for a number of steps, going on with the current episode of a simulation and starting new ones
+ * when it ends
+ */
+void TabularAgent::train_steps(ScalarModel * model, double ** Q, PhiloxStream & stream, int steps, double alpha,
+                               double epsilon, double disc_factor){
+    while(steps > 0){
+        if (model -> inTerminalState())
+            model -> reset();
+        int obs = state(model);
+        int action = choose_action(Q, obs, epsilon, stream);
+        double r = model->act(action);
+        int new_obs = state(model);
+        double max_val = max(- 99999.0, QTable::max(Q[new_obs], QTable::row_stride(actions)));
+        Q[obs][action] = (1.0 - alpha) * Q[obs][action] + alpha * (r + disc_factor * max_val);
+        steps--;
     }
 }
 
 void TabularAgent::test(int episodes, bool verbose, double disc_factor, bool eval){
-    double sum_scores = 0.0;
-    double sum_error = 0.0;
-    int sum_length = 0;
-    int squared_length = 0;
-    int sum_fracs = 0;
-    int squared_fracs = 0.0;
-    int sum_doses = 0;
-    int squared_doses = 0.0;
-    int sum_w = 0;
-    double sum_survival = 0.0;
-    double squared_survival = 0.0;
-    for (int i = 0; i < episodes; i++){
-        env -> reset();
-        double sum_r = 0;
-        double err = 0.0;
-        int count = 0;
-        int fracs = 0;
-        int doses = 0;
-        int time = 0;
-        int init_hcell = HealthyCell::count;
-        while (!env->inTerminalState()){
-            int obs = state();
-            int action = choose_action(obs, 0.0);
-            double r = env -> act(action);
-            if (verbose)
-                cout << action + 1 << " grays, reward =  " << r << endl;
-            fracs++;
-            doses += action + 1;
-            time += 24;
-            sum_r += r;
-            int new_obs = state();
-            double max_val = - 99999.0;
-            for(int i = 0; i < actions; i++){
-                if(Q_values[new_obs][i] > max_val)
-                    max_val = Q_values[new_obs][i];
+    TestTotals totals;
+    if (workers.empty() || verbose){
+        // The verbose output of the episodes is only readable when they run one after the other
+        for (int i = 0; i < episodes; i++)
+            test_episode(env, rng, verbose, disc_factor, totals);
+    } else {
+        int num_workers = (int) workers.size();
+        std::vector<TestTotals> worker_totals(num_workers);
+        pool -> run(num_workers, [&](int w){
+            for (int i = w; i < episodes; i += num_workers){
+                start_episode(workers[w], i);
+                test_episode(workers[w].env, workers[w].rng, false, disc_factor, worker_totals[w]);
             }
-            err += pow(r + disc_factor * max_val - Q_values[obs][action], 2.0);
-            count++;
-        }
-        if(verbose)
-            cout << env -> end_type << endl;
-        if (env -> end_type == 'W')
-            sum_w++;
-        if (eval){
-            sum_fracs += fracs;
-            squared_fracs += fracs * fracs;
-            sum_doses += doses;
-            squared_doses += doses*doses;
-            sum_length += time;
-            squared_length += time*time;
-            double survival = (double) HealthyCell::count / (double) init_hcell;
-            sum_survival += survival;
-            squared_survival += survival * survival;
-        }
-        sum_scores += sum_r;
-        sum_error += err / (double) count;
+        });
+        for (int w = 0; w < num_workers; w++)
+            totals.add(worker_totals[w]);
     }
-    cout << "Average score: " << sum_scores / (double) episodes << " MSE: " << sum_error / (double) episodes << endl;
+    cout << "Average score: " << totals.scores / (double) episodes << " MSE: " << totals.error / (double) episodes << endl;
     if(eval){
-        cout << "TCP: " << 100.0 * (double) sum_w / (double) episodes << endl;
+        cout << "TCP: " << 100.0 * (double) totals.wins / (double) episodes << endl;
 
-        double mean_frac = (double) sum_fracs / (double) episodes;
-        double std_frac = sqrt(((double) squared_fracs / (double) episodes) - (mean_frac * mean_frac));
+        double mean_frac = (double) totals.fracs / (double) episodes;
+        double std_frac = sqrt(((double) totals.squared_fracs / (double) episodes) - (mean_frac * mean_frac));
         cout << "Average num of fractions: " << mean_frac << " std dev: "<< std_frac <<endl;
 
-        double mean_dose = (double) sum_doses / (double) episodes;
-        double std_dose = sqrt(((double) squared_doses / (double) episodes) - (mean_dose * mean_dose));
+        double mean_dose = (double) totals.doses / (double) episodes;
+        double std_dose = sqrt(((double) totals.squared_doses / (double) episodes) - (mean_dose * mean_dose));
         cout << "Average radiation dose: " << mean_dose << " std dev: "<< std_dose <<endl;
 
-        double mean_duration = (double) sum_length / (double) episodes;
-        double std_duration = sqrt(((double) squared_length / (double) episodes) - (mean_duration * mean_duration));
+        double mean_duration = (double) totals.length / (double) episodes;
+        double std_duration = sqrt(((double) totals.squared_length / (double) episodes) - (mean_duration * mean_duration));
         cout << "Average duration: " << mean_duration << " std dev: "<< std_duration <<endl;
 
-        double mean_survival = (double) sum_survival / (double) episodes;
-        double std_survival = sqrt(((double) squared_survival / (double) episodes) - (mean_survival * mean_survival));
+        double mean_survival = (double) totals.survival / (double) episodes;
+        double std_survival = sqrt(((double) totals.squared_survival / (double) episodes) - (mean_survival * mean_survival));
         cout << "Average survival: " << mean_survival << " std dev: "<< std_survival <<endl;
     }
 }
 
+/**
+ * Run one greedy episode from a new simulation and add its results to totals
+ */
+void TabularAgent::test_episode(ScalarModel * model, PhiloxStream & stream, bool verbose, double disc_factor,
+                                TestTotals & totals){
+    model -> reset();
+    double sum_r = 0;
+    double err = 0.0;
+    int count = 0;
+    int fracs = 0;
+    int doses = 0;
+    int time = 0;
+    int init_hcell = model -> hcell_count();
+    while (!model->inTerminalState()){
+        int obs = state(model);
+        int action = choose_action(Q_values, obs, 0.0, stream);
+        double r = model -> act(action);
+        if (verbose)
+            cout << action + 1 << " grays, reward =  " << r << endl;
+        fracs++;
+        doses += action + 1;
+        time += 24;
+        sum_r += r;
+        int new_obs = state(model);
+        double max_val = max(- 99999.0, QTable::max(Q_values[new_obs], QTable::row_stride(actions)));
+        err += pow(r + disc_factor * max_val - Q_values[obs][action], 2.0);
+        count++;
+    }
+    if(verbose)
+        cout << model -> end_type << endl;
+    if (model -> end_type == 'W')
+        totals.wins++;
+    totals.fracs += fracs;
+    totals.squared_fracs += fracs * fracs;
+    totals.doses += doses;
+    totals.squared_doses += doses*doses;
+    totals.length += time;
+    totals.squared_length += time*time;
+    double survival = (double) model -> hcell_count() / (double) init_hcell;
+    totals.survival += survival;
+    totals.squared_survival += survival * survival;
+    totals.scores += sum_r;
+    totals.error += err / (double) count;
+}
+
 void TabularAgent::run(int n_epochs, int train_steps, int test_steps, double init_alpha, double alpha_mult, double init_epsilon, double end_epsilon, double disc_factor){
     test(test_steps, false, disc_factor, false);
     double alpha = init_alpha;
@@ -352,20 +562,36 @@ void TabularAgent::run(int n_epochs, int train_steps, int test_steps, double ini
     }
 }
 
+/**
+ * Run one greedy episode from a new simulation and record the doses of its fractions in treatment
+ */
+void TabularAgent::treatment_episode(ScalarModel * model, PhiloxStream & stream, int * treatment){
+    model -> reset();
+    int j = 0;
+    while (!model->inTerminalState()){
+        int obs = state(model);
+        int action = choose_action(Q_values, obs, 0.0, stream);
+        model -> act(action);
+        treatment[j++] = action + 1;
+    }
+}
+
 void TabularAgent::treatment_var(int count){
     int** treatments = new int*[count];
     for(int i = 0; i < count; i++){
         treatments[i] = new int[100]();
     }
-    for(int i = 0; i < count; i++){
-        env -> reset();
-        int j = 0;
-        while (!env->inTerminalState()){
-            int obs = state();
-            int action = choose_action(obs, 0.0);
-            double r = env -> act(action);
-            treatments[i][j++] = action + 1;
-        }
+    if (workers.empty()){
+        for(int i = 0; i < count; i++)
+            treatment_episode(env, rng, treatments[i]);
+    } else {
+        int num_workers = (int) workers.size();
+        pool -> run(num_workers, [&](int w){
+            for (int i = w; i < count; i += num_workers){
+                start_episode(workers[w], i);
+                treatment_episode(workers[w].env, workers[w].rng, treatments[i]);
+            }
+        });
     }
     cout << "count, mean, std_error" << endl;
     for(int j = 0; j < 100; j++){
@@ -408,7 +634,24 @@ void TabularAgent::save_Q(string name){
     myfile.close();
 }
 
+/**
+ * Save the Q-table in the binary format of QTable::save, which load_Q maps instead of parsing
+ */
+void TabularAgent::save_Q_binary(string name){
+    Q_table -> save(name);
+}
+
+/**
+ * Load the Q-table from a file written by save_Q or save_Q_binary
+ *
+ * Binary files are mapped read-only (see QTable::map), and only copied if the agent is trained afterwards.
+ */
 void TabularAgent::load_Q(string name){
+    if (QTable::is_binary(name)){
+        Q_table -> map(name);
+        return;
+    }
+    Q_table -> make_writable();
     ifstream f;
     //cout << "Trying to open "<< name << endl; 
     f.open(name);
@@ -440,10 +683,10 @@ void TabularAgent::load_Q(string name){
 
 void no_treatment(){
     cout << "No treatment" << endl;
-    ScalarModel * model = new ScalarModel('a');
+    ScalarModel * model = new ScalarModel('a', 5);
     model -> reset();
     for(int i = 350; i < 2000; i += 50){
-        cout << "Time: " << i << " Healthy cells: " <<  HealthyCell::count << " Cancer cells: " << CancerCell::count << endl;
+        cout << "Time: " << i << " Healthy cells: " <<  model -> hcell_count() << " Cancer cells: " << model -> ccell_count() << endl;
         model -> go(50);
     }
     delete model;
@@ -451,7 +694,7 @@ void no_treatment(){
 
 void low_treatment(char reward){
     cout << "Low treatment" << endl;
-    ScalarModel * model = new ScalarModel(reward);
+    ScalarModel * model = new ScalarModel(reward, 5);
     double sum_scores = 0.0;
     for(int i = 0; i < 25; i++){
         model -> reset();
@@ -470,7 +713,7 @@ void low_treatment(char reward){
 
 void baseline_treatment(char reward){
     cout << "Baseline treatment" << endl;
-    ScalarModel * model = new ScalarModel(reward);
+    ScalarModel * model = new ScalarModel(reward, 5);
     double sum_scores = 0.0;
     for(int i = 0; i < 25; i++){
         model -> reset();
@@ -489,7 +732,7 @@ void baseline_treatment(char reward){
 
 void eval_baseline(char reward, int count){
     cout << "Baseline treatment" << endl;
-    ScalarModel * model = new ScalarModel(reward);
+    ScalarModel * model = new ScalarModel(reward, 5);
     int sum_length = 0;
     int squared_length = 0;
     int sum_fracs = 0;
@@ -505,7 +748,7 @@ void eval_baseline(char reward, int count){
         int fracs = 0;
         int doses = 0;
         int time = 0;
-        int init_hcell = HealthyCell::count;
+        int init_hcell = model -> hcell_count();
         while (!model->inTerminalState()){
             int action = (count_f++ < 35)?1:1;
             model -> act(action);
@@ -519,7 +762,7 @@ void eval_baseline(char reward, int count){
         squared_doses += doses*doses;
         sum_length += time;
         squared_length += time*time;
-        double survival = (double) HealthyCell::count / (double) init_hcell;
+        double survival = (double) model -> hcell_count() / (double) init_hcell;
         sum_survival += survival;
         squared_survival += survival * survival;
         if (model -> end_type == 'W')
@@ -548,7 +791,7 @@ void eval_baseline(char reward, int count){
 
 void high_treatment(char reward){
     cout << "High treatment" << endl;
-    ScalarModel * model = new ScalarModel(reward);
+    ScalarModel * model = new ScalarModel(reward, 5);
     double sum_scores = 0.0;
     for(int i = 0; i < 25; i++){
         model -> reset();
@@ -567,7 +810,7 @@ void high_treatment(char reward){
 
 void high_low_treatment(char reward){
     cout << "High low treatment" << endl;
-    ScalarModel * model = new ScalarModel(reward);
+    ScalarModel * model = new ScalarModel(reward, 5);
     double sum_scores = 0.0;
     for(int i = 0; i < 25; i++){
         model -> reset();
@@ -587,6 +830,40 @@ void high_low_treatment(char reward){
     delete model;
 }
 
+/**
+ * Compare the per-cell model with the cohorts (see ScalarModel::use_cohorts) under the baseline treatment, printing the
+ * mean and standard deviation of the number of cells after each of the first fractions
+ */
+void compare_engines(char reward, int count){
+    const int fractions = 35;
+    for(int engine = 0; engine < 2; engine++){
+        cout << (engine == 0 ? "Individual cells" : "Cohorts") << endl;
+        ScalarModel * model = new ScalarModel(reward, 5);
+        model -> use_cohorts(engine == 1);
+        double sum_h[fractions] = {0.0}, squared_h[fractions] = {0.0};
+        double sum_c[fractions] = {0.0}, squared_c[fractions] = {0.0};
+        for(int i = 0; i < count; i++){
+            model -> reset();
+            for(int j = 0; j < fractions; j++){
+                if (!model -> inTerminalState())
+                    model -> act(1);
+                sum_h[j] += model -> hcell_count();
+                squared_h[j] += (double) model -> hcell_count() * model -> hcell_count();
+                sum_c[j] += model -> ccell_count();
+                squared_c[j] += (double) model -> ccell_count() * model -> ccell_count();
+            }
+        }
+        cout << "fraction, healthy mean, std dev, cancer mean, std dev" << endl;
+        for(int j = 0; j < fractions; j++){
+            double mean_h = sum_h[j] / (double) count;
+            double mean_c = sum_c[j] / (double) count;
+            cout << j + 1 << ", " << mean_h << ", " << sqrt(max(squared_h[j] / (double) count - mean_h * mean_h, 0.0))
+                 << ", " << mean_c << ", " << sqrt(max(squared_c[j] / (double) count - mean_c * mean_c, 0.0)) << endl;
+        }
+        delete model;
+    }
+}
+
 void test_suite(char reward){
     low_treatment(reward);
     baseline_treatment(reward);
@@ -595,6 +872,7 @@ void test_suite(char reward){
 }
 
 void TabularAgent::change_val(int state, int action, double val){
+    Q_table -> make_writable();
     Q_values[state][action] = val;
 }
 
@@ -602,6 +880,11 @@ void TabularAgent::change_val(int state, int action, double val){
 int main(int argc, char * argv[]){
     int n_epochs, cancer_cell_stages, healthy_cell_stages;
     char reward, state_type;
+    // "main compare [count] [reward]" checks that the cohorts match the per-cell model over count episodes
+    if(argc >= 2 && string(argv[1]) == "compare"){
+        compare_engines(argc >= 4 ? argv[3][0] : 'd', argc >= 3 ? stoi(argv[2]) : 100);
+        return 0;
+    }
     if(argc == 1){
         n_epochs = 0;
         reward = 'd';
@@ -615,7 +898,7 @@ int main(int argc, char * argv[]){
         cancer_cell_stages = stoi(argv[4]);
         healthy_cell_stages = stoi(argv[5]);
     }
-    ScalarModel * model = new ScalarModel(reward);
+    ScalarModel * model = new ScalarModel(reward, 5);
     TabularAgent * agent = new TabularAgent(model, cancer_cell_stages, healthy_cell_stages, 5, state_type);
     if(argc == 8 && argv[7][0] == 'l'){
         agent -> load_Q(argv[6]);
@@ -624,6 +907,8 @@ int main(int argc, char * argv[]){
         for(int i = 0; i < 250; i++)
             agent -> change_val(i, 1, 1.0);
     }
+    // The evaluation episodes are spread over all the cores
+    agent -> set_threads((int) thread::hardware_concurrency(), 5, 100);
     //agent -> run(n_epochs, 5000, 10, 0.8, 0.05, 0.8, 0.01, 0.99);
     //agent -> test(5, true, 0.99, false);
     agent -> test(1000, false, 0.99, true);
@@ -2,22 +2,37 @@
 #define RADIO_RL_SCALAR_MODEL_H
 
 #include <string>
+#include <vector>
 #include "cell.h"
+#include "cohort_population.h"
 #include "grid.h"
+#include "q_table.h"
+#include "sim_context.h"
+
+class ThreadPool;
 
 class ScalarModel{
 public:
-    ScalarModel(char reward);
+    ScalarModel(char reward, unsigned int seed);
     ~ScalarModel();
     void reset();
+    void reseed(unsigned int seed);
     void go(int hours);
     double act(int action);
     bool inTerminalState();
+    int hcell_count();
+    int ccell_count();
+    char get_reward();
+    void use_cohorts(bool enabled);
+    bool uses_cohorts();
     char end_type;
 private:
     char reward;
+    SimContext ctx;
+    CellPool pool; // Holds all the cells of the model, emptied at once on reset
     CellList * cancer_cells;
     CellList * healthy_cells;
+    CohortPopulation * cohorts; // Replaces the cell lists when not nullptr, see use_cohorts
     int time;
     double glucose;
     double oxygen;
@@ -28,6 +43,34 @@ private:
     double adjust_reward(int dose, int ccell_killed, int hcells_lost);
 };
 
+/**
+ * Sums over the test episodes run by one thread of a TabularAgent, added together once all the threads are done
+ */
+struct TestTotals {
+    TestTotals();
+    void add(const TestTotals & other);
+    double scores;
+    double error;
+    int length;
+    int squared_length;
+    int fracs;
+    int squared_fracs;
+    int doses;
+    int squared_doses;
+    int wins;
+    double survival;
+    double squared_survival;
+};
+
+/**
+ * Simulation, exploration stream and Q-table used by one thread of a TabularAgent running episodes in parallel
+ */
+struct AgentWorker {
+    ScalarModel * env;
+    QTable * Q_table; // The worker's own copy of the table while training, averaged into the agent's every round
+    PhiloxStream rng;
+};
+
 class TabularAgent{
 public:
     TabularAgent(ScalarModel * env, int cancer_cell_stages, int healthy_cell_stages, int actions, char state_type);
@@ -36,20 +79,36 @@ public:
     void test(int episodes, bool verbose, double disc_factor, bool eval);
     void run(int n_epochs, int train_steps, int test_steps, double init_alpha, double alpha_mult, double init_epsilon, double end_epsilon, double disc_factor);
     void save_Q(std::string name);
+    void save_Q_binary(std::string name);
     void load_Q(std::string name);
     void treatment_var(int count);
     void change_val(int state, int action, double val);
+    void set_threads(int num_threads, unsigned int seed, int sync_steps);
+    int get_threads();
 private:
     ScalarModel * env;
     int cancer_cell_stages;
     int healthy_cell_stages;
     int actions;
     char state_type;
-    double ** Q_values;
+    QTable * Q_table;
+    double ** Q_values; // Rows of Q_table
     double state_helper_hcells;
     double state_helper_ccells;
-    int state();
-    int choose_action(int state, double epsilon);
+    PhiloxStream rng; // Exploration of the agent
+    unsigned int seed; // Seed of the simulations of the workers
+    unsigned int train_calls; // Number of calls to train with several threads, each starting new simulations
+    int sync_steps; // Steps trained by each worker between two averagings of the tables
+    ThreadPool * pool;
+    std::vector<AgentWorker> workers; // Empty when the episodes run on a single thread
+    int state(ScalarModel * model);
+    int choose_action(double ** Q, int state, double epsilon, PhiloxStream & stream);
+    void train_steps(ScalarModel * model, double ** Q, PhiloxStream & stream, int steps, double alpha, double epsilon,
+                     double disc_factor);
+    void test_episode(ScalarModel * model, PhiloxStream & stream, bool verbose, double disc_factor, TestTotals & totals);
+    void treatment_episode(ScalarModel * model, PhiloxStream & stream, int * treatment);
+    void start_episode(AgentWorker & worker, int episode);
+    void clear_workers();
 };
 
 #endif
@@ -1,17 +1,47 @@
 #Creates the Python package that allows to interact with the simulation C++ implementation
+import os
 try:
     from distutils.core import setup, Extension
     import numpy
 except:
     raise RuntimeError("\n\nPython distutils not found!\n")
 
+# Build configuration, chosen with the CPPCELLMODEL_BUILD environment variable, with the same meaning as the MODE of the
+# Makefile. The sanitizer builds need their runtime preloaded in Python, e.g. LD_PRELOAD=$(g++ -print-file-name=libasan.so)
+build = os.environ.get('CPPCELLMODEL_BUILD', 'release')
+march = os.environ.get('CPPCELLMODEL_MARCH', 'native')
+# CPPCELLMODEL_STATS=0 compiles out the statistics returned by cppCellModel.stats, see sim_stats.h
+stats = os.environ.get('CPPCELLMODEL_STATS', '1')
+profile_dir = os.path.abspath(os.path.join('build', 'pgo-module'))
+base_flags = ['-std=gnu++11', '-pthread', '-ffp-contract=off']
+mode_flags = {
+    'release': ['-O3', '-march=' + march, '-flto=auto'],
+    'profile': ['-O3', '-march=' + march, '-g', '-fno-omit-frame-pointer'],
+    'asan': ['-O1', '-g', '-fno-omit-frame-pointer', '-fsanitize=address,undefined'],
+    'tsan': ['-O1', '-g', '-fsanitize=thread'],
+    'debug': ['-O0', '-g'],
+    'pgo-generate': ['-O3', '-march=' + march, '-flto=auto', '-fprofile-generate=' + profile_dir,
+                     '-fprofile-update=atomic'],
+    'pgo': ['-O3', '-march=' + march, '-flto=auto', '-fprofile-use=' + profile_dir, '-fprofile-correction',
+            '-Wno-missing-profile'],
+}
+if build not in mode_flags:
+    raise RuntimeError("Unknown CPPCELLMODEL_BUILD " + build + ", expected one of " + ", ".join(mode_flags))
+# Compiled after the default flags of Python, so that the optimization level of the configuration wins
+flags = base_flags + mode_flags[build]
+if stats == '0':
+    flags.append('-DRADIO_RL_NO_STATS')
+
 # Definition of extension modules
 cppCellModel = Extension('cppCellModel',
-                 sources = ['cell.cpp', 'grid.cpp', 'controller.cpp', 'model.cpp'], extra_compile_args=['-std=gnu++11'],
+                 sources = ['cell.cpp', 'grid.cpp', 'controller.cpp', 'model.cpp', 'sim_context.cpp', 'thread_pool.cpp',
+                            'vec_controller.cpp', 'cell_store.cpp',
+                            'diffusion.cpp', 'checkpoint.cpp', 'dose_map.cpp',
+                            'cell_pool.cpp', 'trace.cpp'], extra_compile_args=flags, extra_link_args=['-pthread'] + mode_flags[build],
                 include_dirs = [numpy.get_include()])
 
 # Compile Python module
 setup (ext_modules = [cppCellModel],
        name = 'cppCellModel',
        description = 'cppModel Python module',
-       version = '1.0')
\ No newline at end of file
+       version = '1.0')
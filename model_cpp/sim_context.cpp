@@ -0,0 +1,126 @@
+#include "sim_context.h"
+#include <sstream>
+
+
+/**
+ * Constructor of SimContext
+ *
+ * @param seed The seed of the random streams of this simulation
+ */
+SimContext::SimContext(unsigned int seed): hcell_count(0), ccell_count(0), oar_count(0), seed(seed), epoch(0),
+                                           cell_selected(false) {
+    main_stream.start(seed, 0, 0, MAIN_STREAM);
+}
+
+/**
+ * Set all the population counters back to zero
+ */
+void SimContext::reset_counts(){
+    hcell_count = 0;
+    ccell_count = 0;
+    oar_count = 0;
+}
+
+/**
+ * Restart the random streams from a new seed, leaving the population counters untouched
+ *
+ * @param seed The new seed of the random streams
+ */
+void SimContext::reseed(unsigned int seed){
+    this -> seed = seed;
+    epoch = 0;
+    main_stream.start(seed, 0, 0, MAIN_STREAM);
+    cell_selected = false;
+}
+
+/**
+ * Draw the streams of the cells from the same seed and epoch as another context, used by the threads of a Grid which
+ * keep their own population counters
+ *
+ * @param other The context whose cell streams are shared
+ */
+void SimContext::share_streams(const SimContext & other){
+    seed = other.seed;
+    epoch = other.epoch;
+    cell_selected = false;
+}
+
+/**
+ * Move to the next epoch, in which every cell gets a new stream
+ */
+void SimContext::next_epoch(){
+    epoch++;
+    cell_selected = false;
+}
+
+/**
+ * Return the state of the random streams as text, from which set_state restores them exactly
+ */
+std::string SimContext::get_state(){
+    std::ostringstream out;
+    out << seed << ' ' << epoch << ' ';
+    main_stream.write(out);
+    return out.str();
+}
+
+/**
+ * Restore the random streams from a state returned by get_state
+ *
+ * @param state The text representation of the state
+ * @return false if the state could not be parsed, in which case the streams are left in an unspecified state
+ */
+bool SimContext::set_state(const std::string & state){
+    std::istringstream in(state);
+    in >> seed >> epoch;
+    cell_selected = false;
+    return !in.fail() && main_stream.read(in);
+}
+
+/**
+ * Draw, for a run of cells of the same pixel, the normal draws setting their nutrient efficiency for this epoch
+ *
+ * The draws are made from a stream of their own, two cells sharing each block, so that the whole run is served by a
+ * single loop over the blocks of its slots, independently of the other draws of the cells.
+ *
+ * @param out Set to the draws of the cells, count values
+ * @param count Number of cells
+ * @param pixel The pixel of the cells
+ * @param first_slot The index of the first cell among the cells of its pixel, the others following it
+ */
+void SimContext::fill_norm(double * out, int count, int pixel, int first_slot){
+    uint32_t key[2] = {seed, epoch};
+    uint32_t counter[4] = {0, 0, 0, ((uint32_t) pixel << 2) | EFFICIENCY_STREAM};
+    uint32_t words[4];
+    for (int n = 0; n < count; n++){
+        int slot = first_slot + n;
+        if (n == 0 || slot % 2 == 0){
+            counter[0] = (uint32_t) slot / 2;
+            PhiloxStream::block(counter, key, words);
+        }
+        int half = 2 * (slot % 2);
+        out[n] = 1.0 + 0.3333333 * PhiloxStream::to_normal(words[half], words[half + 1]);
+    }
+}
+
+/**
+ * Draw, for a run of cells of the same pixel, the pairs of draws from [0, 1) deciding their fate when irradiated in this
+ * epoch (see HealthyCell::radiate_kernel)
+ *
+ * The draws are made from a stream of their own, each cell using one block.
+ *
+ * @param out Set to the draws of the cells, 2 * count values, the draws of a cell following each other
+ * @param count Number of cells
+ * @param pixel The pixel of the cells
+ * @param first_slot The index of the first cell among the cells of its pixel, the others following it
+ */
+void SimContext::fill_uniform(double * out, int count, int pixel, int first_slot){
+    uint32_t key[2] = {seed, epoch};
+    uint32_t counter[4] = {0, 0, 0, ((uint32_t) pixel << 2) | RADIATION_STREAM};
+    uint32_t words[4];
+    for (int n = 0; n < count; n++){
+        counter[0] = (uint32_t) (first_slot + n);
+        PhiloxStream::block(counter, key, words);
+        out[2 * n] = PhiloxStream::to_uniform(words[0], words[1]);
+        out[2 * n + 1] = PhiloxStream::to_uniform(words[2], words[3]);
+    }
+}
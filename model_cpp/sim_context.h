@@ -0,0 +1,111 @@
+#ifndef RADIO_RL_SIM_CONTEXT_H
+#define RADIO_RL_SIM_CONTEXT_H
+
+#include <string>
+#include "philox.h"
+#include "sim_stats.h"
+
+/**
+ * State shared by all the cells of a single simulation
+ *
+ * Holds the population counters, the random streams and the statistics (see SimStats) of one Grid or ScalarModel, so
+ * that several simulations can run in the same process without corrupting each other's populations.
+ *
+ * Random numbers come from counter-based streams (see philox.h) keyed by the seed of the simulation. Draws that are not
+ * tied to a cell (positions of the sources, initial cells...) come from a single main stream read in sequence. Each
+ * epoch (one hour of the cell cycle, or one irradiation) gives every cell its own stream, identified by its pixel and its
+ * slot among the cells of this pixel, which select() makes current. The draws of a cell thus only depend on the seed,
+ * the epoch and the position of the cell, and not on the order in which the cells are processed or on the number of
+ * threads processing them.
+ */
+class SimContext {
+public:
+    SimContext(unsigned int seed);
+    void reset_counts();
+    void reseed(unsigned int seed);
+    void share_streams(const SimContext & other);
+    void next_epoch();
+    void select(int pixel, int slot);
+    void select_main();
+    std::string get_state();
+    bool set_state(const std::string & state);
+    int rand_int();
+    double norm();
+    double uniform();
+    double normal();
+    void fill_norm(double * out, int count, int pixel, int first_slot);
+    void fill_uniform(double * out, int count, int pixel, int first_slot);
+    int hcell_count;
+    int ccell_count;
+    int oar_count;
+    SimStats stats;
+private:
+    PhiloxStream & stream();
+    unsigned int seed;
+    unsigned int epoch;
+    PhiloxStream main_stream;
+    PhiloxStream cell_stream; // Stream of the cell selected by select()
+    bool cell_selected; // Whether draws come from cell_stream rather than main_stream
+};
+
+/*
+ * Identifiers of the kinds of streams, kept in the last word of their counter so that they never overlap
+ */
+enum StreamDomain : uint32_t {
+    MAIN_STREAM = 0,
+    CELL_STREAM = 1,
+    EFFICIENCY_STREAM = 2,
+    RADIATION_STREAM = 3
+};
+
+inline PhiloxStream & SimContext::stream(){
+    return cell_selected ? cell_stream : main_stream;
+}
+
+/**
+ * Make the stream of a cell current for this epoch
+ *
+ * @param pixel The pixel of the cell
+ * @param slot The index of the cell among the cells of its pixel
+ */
+inline void SimContext::select(int pixel, int slot){
+    cell_stream.start(seed, epoch, (uint32_t) slot, ((uint32_t) pixel << 2) | CELL_STREAM);
+    cell_selected = true;
+}
+
+/**
+ * Make the main stream current again
+ */
+inline void SimContext::select_main(){
+    cell_selected = false;
+}
+
+/**
+ * Draw a non-negative random integer, used in place of rand()
+ */
+inline int SimContext::rand_int(){
+    return (int) (stream().next() >> 1);
+}
+
+/**
+ * Draw from the normal distribution used for the nutrient efficiency of cells
+ */
+inline double SimContext::norm(){
+    return 1.0 + 0.3333333 * stream().normal();
+}
+
+/**
+ * Draw uniformly from [0, 1)
+ */
+inline double SimContext::uniform(){
+    return stream().uniform();
+}
+
+/**
+ * Draw from the standard normal distribution
+ */
+inline double SimContext::normal(){
+    return stream().normal();
+}
+
+#endif //RADIO_RL_SIM_CONTEXT_H
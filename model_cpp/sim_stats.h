@@ -0,0 +1,129 @@
+#ifndef RADIO_RL_SIM_STATS_H
+#define RADIO_RL_SIM_STATS_H
+
+#include <chrono>
+#include "trace.h"
+
+/**
+ * Phases of a tick of a Grid whose time is measured in its SimStats
+ */
+enum SimPhase {
+    FILL_SOURCES_PHASE,
+    CYCLE_CELLS_PHASE,
+    DIFFUSE_PHASE,
+    COMPUTE_CENTER_PHASE,
+    IRRADIATE_PHASE,
+    PHASE_COUNT
+};
+
+/**
+ * Counters of the work done by a simulation, kept in its SimContext
+ *
+ * Holds the time spent in each SimPhase and counts of the events of the cells, so that the cost of a tick can be put
+ * down to the size of the tumor or to the activity of the OAR. Counting costs a clock read at each end of a phase and
+ * a few additions per pixel, and can be removed at compile time with -DRADIO_RL_NO_STATS, in which case SIM_STAT
+ * statements and PhaseTimers do nothing, all counters stay at zero and the phases no longer appear in the Trace.
+ */
+struct SimStats {
+    SimStats();
+    void reset();
+    void add_events(const SimStats & other);
+    static const char * phase_name(int phase);
+    double phase_seconds[PHASE_COUNT]; // Wall time spent in each phase
+    long long phase_calls[PHASE_COUNT];
+    long long cells_cycled; // Cells advanced by one hour in their cycle
+    long long mitoses; // Cells created by a division
+    long long starvation_deaths;
+    long long radiation_deaths;
+    long long allocations; // Reallocations of the storage of the cells to hold more of them
+    long long compactions; // Rebuilds of the storage of the cells, removing the dead ones and inserting the new ones
+};
+
+#ifdef RADIO_RL_NO_STATS
+#define SIM_STAT(statement) do {} while (0)
+#else
+#define SIM_STAT(statement) do { statement; } while (0)
+#endif
+
+/**
+ * Measures the time of one call to a phase, from its construction to its destruction, and records it in the Trace if it
+ * is on
+ */
+class PhaseTimer {
+public:
+    PhaseTimer(SimStats & stats, SimPhase phase);
+    ~PhaseTimer();
+#ifndef RADIO_RL_NO_STATS
+private:
+    SimStats & stats;
+    SimPhase phase;
+    std::chrono::steady_clock::time_point start;
+#endif
+};
+
+inline SimStats::SimStats(){
+    reset();
+}
+
+/**
+ * Set all the counters back to zero
+ */
+inline void SimStats::reset(){
+    for (int phase = 0; phase < PHASE_COUNT; phase++){
+        phase_seconds[phase] = 0.0;
+        phase_calls[phase] = 0;
+    }
+    cells_cycled = 0;
+    mitoses = 0;
+    starvation_deaths = 0;
+    radiation_deaths = 0;
+    allocations = 0;
+    compactions = 0;
+}
+
+/**
+ * Add the event counts of other, used to merge the counts of the tiles of a multithreaded cycle_cells
+ */
+inline void SimStats::add_events(const SimStats & other){
+    cells_cycled += other.cells_cycled;
+    mitoses += other.mitoses;
+    starvation_deaths += other.starvation_deaths;
+    radiation_deaths += other.radiation_deaths;
+    allocations += other.allocations;
+    compactions += other.compactions;
+}
+
+/**
+ * Return the name of a phase, that of the Grid method it measures
+ */
+inline const char * SimStats::phase_name(int phase){
+    static const char * const names[PHASE_COUNT] = {"fill_sources", "cycle_cells", "diffuse", "compute_center",
+                                                    "irradiate"};
+    return names[phase];
+}
+
+#ifdef RADIO_RL_NO_STATS
+
+inline PhaseTimer::PhaseTimer(SimStats &, SimPhase){}
+
+inline PhaseTimer::~PhaseTimer(){}
+
+#else
+
+inline PhaseTimer::PhaseTimer(SimStats & stats, SimPhase phase): stats(stats), phase(phase),
+        start(std::chrono::steady_clock::now()) {}
+
+inline PhaseTimer::~PhaseTimer(){
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    stats.phase_seconds[phase] += elapsed.count();
+    stats.phase_calls[phase]++;
+    if (Trace::enabled()){
+        std::chrono::nanoseconds time = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch());
+        Trace::record(SimStats::phase_name(phase), 'X', time.count(),
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+}
+
+#endif
+
+#endif //RADIO_RL_SIM_STATS_H
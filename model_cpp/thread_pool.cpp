@@ -0,0 +1,75 @@
+#include "thread_pool.h"
+
+
+/**
+ * Constructor of ThreadPool
+ *
+ * @param num_threads The number of worker threads, if it is 1 or less all tasks are run on the calling thread
+ */
+ThreadPool::ThreadPool(int num_threads): current(nullptr), num_tasks(0), next_task(0), running(0), stopping(false){
+    for (int i = 0; i < num_threads && num_threads > 1; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+/**
+ * Destructor of ThreadPool, waits for the workers to finish
+ */
+ThreadPool::~ThreadPool(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_ready.notify_all();
+    for (std::thread & worker : workers)
+        worker.join();
+}
+
+/**
+ * Return the number of threads that tasks are spread over
+ */
+int ThreadPool::size(){
+    return workers.empty() ? 1 : (int) workers.size();
+}
+
+/**
+ * Run task(0) ... task(num_tasks - 1) on the workers and wait until all of them have returned
+ *
+ * @param num_tasks The number of tasks
+ * @param task The function called with the index of each task
+ */
+void ThreadPool::run(int num_tasks, const std::function<void(int)> & task){
+    if (workers.empty()){
+        for (int i = 0; i < num_tasks; i++)
+            task(i);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    current = &task;
+    this -> num_tasks = num_tasks;
+    next_task = 0;
+    running = 0;
+    task_ready.notify_all();
+    task_done.wait(lock, [this]{ return next_task >= this -> num_tasks && running == 0; });
+    current = nullptr;
+}
+
+/**
+ * Main loop of a worker thread: take the next task index until there is none left
+ */
+void ThreadPool::work(){
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true){
+        task_ready.wait(lock, [this]{ return stopping || (current && next_task < num_tasks); });
+        if (stopping)
+            return;
+        int i = next_task++;
+        running++;
+        const std::function<void(int)> * task = current;
+        lock.unlock();
+        (*task)(i);
+        lock.lock();
+        running--;
+        if (next_task >= num_tasks && running == 0)
+            task_done.notify_all();
+    }
+}
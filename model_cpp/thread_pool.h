@@ -0,0 +1,35 @@
+#ifndef RADIO_RL_THREAD_POOL_H
+#define RADIO_RL_THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads used to run independent tasks in parallel
+ *
+ * The only operation is a blocking parallel loop: run(n, task) calls task(0) ... task(n - 1) on the workers and returns
+ * once all of them are done.
+ */
+class ThreadPool {
+public:
+    ThreadPool(int num_threads);
+    ~ThreadPool();
+    void run(int num_tasks, const std::function<void(int)> & task);
+    int size();
+private:
+    void work();
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable task_ready;
+    std::condition_variable task_done;
+    const std::function<void(int)> * current;
+    int num_tasks;
+    int next_task;
+    int running;
+    bool stopping;
+};
+
+#endif //RADIO_RL_THREAD_POOL_H
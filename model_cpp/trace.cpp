@@ -0,0 +1,201 @@
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+static const int name_words = 5; // The name of an event is kept in 40 bytes
+
+/*
+ * An event of the ring buffer, written and read as a seqlock
+ *
+ * sequence is the index of the event plus one once it has been written, and 0 while a writer is filling the slot. The
+ * fields are atomics, with release stores and acquire loads, so that a reader that sees a value of a writer also sees
+ * the 0 that this writer put in sequence first: dump copies the fields between two loads of sequence and keeps the copy
+ * only if both give the index of the event, which skips the slots not written yet, being written, or holding an event
+ * of a later lap.
+ */
+struct TraceSlot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> name[name_words];
+    std::atomic<char> phase; // 'X' for a complete event, 'B' or 'E' for the beginning or end of a scope
+    std::atomic<uint32_t> thread;
+    std::atomic<int64_t> start;
+    std::atomic<int64_t> duration;
+};
+
+/*
+ * Plain copy of a TraceSlot, made by dump
+ */
+struct TraceEvent {
+    char name[name_words * 8];
+    char phase;
+    uint32_t thread;
+    int64_t start;
+    int64_t duration;
+};
+
+/*
+ * Ring buffer of the events. A ring is never freed, since a thread that was recording when start replaced it may still
+ * write to it: start reuses the ring while the capacity stays the same, and the events of an earlier start are told
+ * apart by their index, below first.
+ */
+struct TraceRing {
+    TraceRing(uint64_t capacity);
+    uint64_t capacity; // A power of 2
+    TraceSlot * slots;
+    std::atomic<uint64_t> next; // Index of the next event
+    uint64_t first; // Index of the first event since start
+};
+
+TraceRing::TraceRing(uint64_t capacity): capacity(capacity), slots(new TraceSlot[capacity]), next(0), first(0) {
+    for (uint64_t i = 0; i < capacity; i++)
+        slots[i].sequence.store(0, std::memory_order_relaxed);
+}
+
+std::atomic<bool> Trace::active(false);
+
+static std::atomic<TraceRing *> trace_ring(nullptr);
+static std::mutex trace_lock; // Serializes start and dump, record takes no lock
+static int64_t trace_origin = 0; // Time at which tracing started, the 0 of the timeline
+static std::atomic<uint32_t> trace_threads(0);
+
+/**
+ * Return a small identifier of the calling thread, numbered in order of first event
+ */
+static uint32_t trace_thread(){
+    static thread_local uint32_t thread = trace_threads.fetch_add(1) + 1;
+    return thread;
+}
+
+/**
+ * Start recording events, discarding those recorded so far
+ *
+ * @param capacity Number of events kept, rounded up to a power of 2
+ */
+void Trace::start(int capacity){
+    std::lock_guard<std::mutex> lock(trace_lock);
+    uint64_t size = 1;
+    while (size < (uint64_t) (capacity > 1 ? capacity : 1))
+        size *= 2;
+    TraceRing * ring = trace_ring.load();
+    if (!ring || ring -> capacity != size){
+        ring = new TraceRing(size);
+        trace_ring.store(ring);
+    }
+    ring -> first = ring -> next.load();
+    trace_origin = now();
+    active.store(true);
+}
+
+/**
+ * Stop recording events, keeping those recorded for dump
+ */
+void Trace::stop(){
+    active.store(false);
+}
+
+/**
+ * Add an event to the ring buffer, does nothing if tracing is off
+ *
+ * @param name Name of the event, truncated to 39 characters
+ * @param phase 'X' for a complete event lasting duration, 'B' or 'E' for the beginning or end of a scope
+ * @param start Time of the event (see now)
+ * @param duration Duration of a complete event, in nanoseconds
+ */
+void Trace::record(const char * name, char phase, int64_t start, int64_t duration){
+    if (!enabled())
+        return;
+    TraceRing * ring = trace_ring.load(std::memory_order_acquire);
+    uint64_t index = ring -> next.fetch_add(1, std::memory_order_relaxed);
+    TraceSlot & slot = ring -> slots[index & (ring -> capacity - 1)];
+    uint64_t words[name_words] = {0};
+    strncpy((char *) words, name, sizeof(words) - 1);
+    slot.sequence.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < name_words; i++)
+        slot.name[i].store(words[i], std::memory_order_release);
+    slot.phase.store(phase, std::memory_order_release);
+    slot.thread.store(trace_thread(), std::memory_order_release);
+    slot.start.store(start, std::memory_order_release);
+    slot.duration.store(duration, std::memory_order_release);
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * Copy the event of a slot, return false if the slot does not hold the event of this index or was written meanwhile
+ */
+static bool read_slot(TraceSlot & slot, uint64_t index, TraceEvent & event){
+    if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+        return false;
+    uint64_t words[name_words];
+    for (int i = 0; i < name_words; i++)
+        words[i] = slot.name[i].load(std::memory_order_acquire);
+    event.phase = slot.phase.load(std::memory_order_acquire);
+    event.thread = slot.thread.load(std::memory_order_acquire);
+    event.start = slot.start.load(std::memory_order_acquire);
+    event.duration = slot.duration.load(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != index + 1)
+        return false;
+    memcpy(event.name, words, sizeof(event.name));
+    event.name[sizeof(event.name) - 1] = '\0';
+    return true;
+}
+
+/**
+ * Write a JSON string, escaping the characters that need it
+ */
+static void write_json_string(FILE * file, const char * text){
+    fputc('"', file);
+    for (const char * c = text; *c; c++){
+        if (*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if ((unsigned char) *c < 0x20)
+            fprintf(file, "\\u%04x", (unsigned char) *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * Write the events kept in the ring buffer, oldest first, as a Chrome trace in JSON
+ *
+ * Times are in microseconds since start. Tracing goes on if it was on, the events recorded while dumping may or may not
+ * be written.
+ *
+ * @param name Path of the file
+ * @return The number of events written
+ */
+int Trace::dump(const std::string & name){
+    std::lock_guard<std::mutex> lock(trace_lock);
+    FILE * file = fopen(name.c_str(), "w");
+    if (!file)
+        throw std::runtime_error("Could not open file");
+    TraceRing * ring = trace_ring.load();
+    uint64_t first = 0;
+    uint64_t last = 0;
+    if (ring){
+        last = ring -> next.load();
+        first = last - ring -> first > ring -> capacity ? last - ring -> capacity : ring -> first;
+    }
+    int written = 0;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (uint64_t index = first; index < last; index++){
+        TraceEvent event;
+        if (!read_slot(ring -> slots[index & (ring -> capacity - 1)], index, event))
+            continue;
+        fprintf(file, written ? ",\n" : "\n");
+        fprintf(file, "{\"name\": ");
+        write_json_string(file, event.name);
+        fprintf(file, ", \"ph\": \"%c\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f", event.phase, event.thread,
+                (event.start - trace_origin) / 1000.0);
+        if (event.phase == 'X')
+            fprintf(file, ", \"dur\": %.3f", event.duration / 1000.0);
+        fprintf(file, "}");
+        written++;
+    }
+    fprintf(file, "\n]}\n");
+    if (fclose(file) != 0)
+        throw std::runtime_error("Could not write file");
+    return written;
+}
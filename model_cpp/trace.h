@@ -0,0 +1,70 @@
+#ifndef RADIO_RL_TRACE_H
+#define RADIO_RL_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Process-wide timeline of the simulation, written as a Chrome trace (chrome://tracing, Perfetto or Tracy's importer)
+ *
+ * While tracing is on (see start), the phases of the Grids (see PhaseTimer) and the scopes opened with TraceScope, such
+ * as the calls of the Python bindings, are recorded as events with their thread and their times. Events go into a ring
+ * buffer that any number of threads write to without locks, each taking the next slot with an atomic increment, so that
+ * only the most recent events are kept once it is full. When tracing is off, recording an event costs one atomic load
+ * per scope.
+ *
+ * All the functions can be called from any thread at any time: dump skips the events that are being written, and the
+ * ring buffer is never freed, so that an event recorded while start runs goes to a buffer that is still allocated.
+ */
+class Trace {
+public:
+    static void start(int capacity);
+    static void stop();
+    static bool enabled();
+    static int64_t now();
+    static void record(const char * name, char phase, int64_t start, int64_t duration);
+    static int dump(const std::string & name);
+private:
+    static std::atomic<bool> active;
+};
+
+/**
+ * Records the lifetime of a scope as a complete event of the Trace
+ */
+class TraceScope {
+public:
+    TraceScope(const char * name);
+    ~TraceScope();
+private:
+    const char * name; // nullptr if tracing was off when the scope was opened
+    int64_t start;
+};
+
+/**
+ * Return true if events are being recorded
+ */
+inline bool Trace::enabled(){
+    return active.load(std::memory_order_acquire);
+}
+
+/**
+ * Return the time of the steady clock in nanoseconds, the clock of all the events
+ */
+inline int64_t Trace::now(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline TraceScope::TraceScope(const char * name): name(Trace::enabled() ? name : nullptr), start(0) {
+    if (this -> name)
+        start = Trace::now();
+}
+
+inline TraceScope::~TraceScope(){
+    if (name)
+        Trace::record(name, 'X', start, Trace::now() - start);
+}
+
+#endif //RADIO_RL_TRACE_H
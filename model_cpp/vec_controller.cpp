@@ -0,0 +1,190 @@
+#include "vec_controller.h"
+#include "philox.h"
+#include <algorithm>
+
+
+/**
+ * Constructor of VecController
+ *
+ * Creates num_envs Controllers with 1000 HealthyCells and lets each of them run for init_steps hours
+ *
+ * @param num_envs The number of simulations in the batch
+ * @param xsize The number of rows of each grid
+ * @param ysize The number of columns of each grid
+ * @param sources_num The number of nutrient sources on each grid
+ * @param init_steps The number of hours simulated before the first treatment
+ * @param reward The type of reward ('d' for dose, 'k' for killed, 'o' for oar), as in CellEnvironment
+ * @param special_reward True if the agent should receive a special reward at the end of the episode
+ * @param max_tick The tick after which an episode ends with a time out
+ * @param seed The seed of the first simulation, the others use the following seeds. The simulations created by reset
+ *             draw their seeds from a Philox stream keyed by this seed, so that they do not reuse the seeds that follow
+ *             the batch.
+ * @param num_threads The number of threads used to advance the simulations
+ * @param scales The 3 factors applied to the channels of the observations, see Controller::observe_state
+ * @param byte_observations true to observe the simulations as unsigned char, false as float
+ */
+VecController::VecController(int num_envs, int xsize, int ysize, int sources_num, int init_steps, char reward,
+                             bool special_reward, int max_tick, unsigned int seed, int num_threads,
+                             const double * scales, bool byte_observations):
+        num_envs(num_envs), xsize(xsize), ysize(ysize), byte_observations(byte_observations), sources_num(sources_num),
+        init_steps(init_steps), reward(reward), special_reward(special_reward), max_tick(max_tick), seed(seed),
+        episodes(0), pool(num_threads){
+    for (int c = 0; c < 3; c++)
+        this -> scales[c] = scales[c];
+    envs = new Controller*[num_envs]();
+    init_hcell_count = new int[num_envs]();
+    done = new bool[num_envs]();
+    last_rewards = new double[num_envs]();
+    pool.run(num_envs, [this, seed](int i){ reset_env(i, seed + i); });
+}
+
+/**
+ * Destructor of VecController
+ */
+VecController::~VecController(){
+    for (int i = 0; i < num_envs; i++)
+        delete envs[i];
+    delete[] envs;
+    delete[] init_hcell_count;
+    delete[] done;
+    delete[] last_rewards;
+}
+
+/**
+ * Derive the seed of the simulation of an episode started by reset from the seed of the batch
+ *
+ * @param seed The seed of the batch
+ * @param episode The number of the episode among those started by reset
+ */
+static unsigned int reset_seed(unsigned int seed, unsigned int episode){
+    uint32_t counter[4] = {episode, 0, 0, 0};
+    uint32_t key[2] = {seed, 1};
+    uint32_t words[4];
+    PhiloxStream::block(counter, key, words);
+    return words[0];
+}
+
+/**
+ * Replace the simulation at index i by a new one that has gone through the initial growth
+ */
+void VecController::reset_env(int i, unsigned int seed){
+    delete envs[i];
+    envs[i] = new Controller(1000, xsize, ysize, sources_num, seed);
+    for (int t = 0; t < init_steps; t++)
+        envs[i] -> go();
+    init_hcell_count[i] = envs[i] -> hcell_count();
+    done[i] = false;
+    last_rewards[i] = 0.0;
+}
+
+/**
+ * Irradiate every simulation with its dose, let it rest for its number of hours and observe the result
+ *
+ * Simulations that have already reached a terminal state are left untouched until they are reset, and get a reward
+ * of 0.
+ *
+ * @param doses The dose of radiation (in grays) of each simulation
+ * @param rest_hours The number of hours simulated after the irradiation of each simulation
+ * @param observations Output array of num_envs * xsize * ysize * 3 elements (see observe)
+ * @param rewards Output array of size num_envs
+ * @param terminals Output array of size num_envs, true if the simulation has reached a terminal state
+ */
+void VecController::step(const double * doses, const int * rest_hours, void * observations, double * rewards,
+                         bool * terminals){
+    pool.run(num_envs, [&](int i){
+        if (done[i])
+            last_rewards[i] = 0.0;
+        else
+            step_env(i, doses[i], rest_hours[i]);
+        observe_env(i, observations);
+    });
+    for (int i = 0; i < num_envs; i++){
+        rewards[i] = last_rewards[i];
+        terminals[i] = done[i];
+    }
+}
+
+/**
+ * Start a new episode for the simulations at the given indices, then observe all simulations
+ *
+ * @param indices The indices of the simulations to reset, which must be distinct since the simulations are reset in
+ *                parallel
+ * @param count The number of indices
+ * @param observations Output array of num_envs * xsize * ysize * 3 elements (see observe)
+ */
+void VecController::reset(const int * indices, int count, void * observations){
+    unsigned int first = episodes;
+    episodes += count;
+    pool.run(count, [&](int k){ reset_env(indices[k], reset_seed(seed, first + k)); });
+    observe(observations);
+}
+
+/**
+ * Observe all the simulations
+ *
+ * @param observations Output array of num_envs * xsize * ysize * 3 elements, of unsigned char if byte_observations is
+ *                     true and of float otherwise, filled with the state of each simulation (see
+ *                     Controller::observe_state) one after the other
+ */
+void VecController::observe(void * observations){
+    pool.run(num_envs, [&](int i){ observe_env(i, observations); });
+}
+
+/**
+ * Write the state of the simulation at index i at its place in observations
+ */
+void VecController::observe_env(int i, void * observations){
+    size_t offset = (size_t) i * xsize * ysize * 3;
+    if (byte_observations)
+        envs[i] -> observe_state((unsigned char *) observations + offset, scales);
+    else
+        envs[i] -> observe_state((float *) observations + offset, scales);
+}
+
+/**
+ * Return the simulation at index i
+ */
+Controller * VecController::get(int i){
+    return envs[i];
+}
+
+/**
+ * Apply one treatment step to the simulation at index i, following CellEnvironment.act
+ */
+void VecController::step_env(int i, double dose, int rest){
+    Controller * env = envs[i];
+    int pre_hcell = env -> hcell_count();
+    int pre_ccell = env -> ccell_count();
+    env -> irradiate(dose);
+    int p_hcell = env -> hcell_count();
+    for (int t = 0; t < rest; t++)
+        env -> go();
+    int post_hcell = env -> hcell_count();
+    int post_ccell = env -> ccell_count();
+    done[i] = in_terminal_state(i);
+    last_rewards[i] = adjust_reward(i, dose, pre_ccell, post_ccell, pre_hcell, p_hcell, post_hcell);
+}
+
+/**
+ * Returns true if the simulation at index i has reached a terminal state
+ */
+bool VecController::in_terminal_state(int i){
+    return envs[i] -> ccell_count() <= 0 || envs[i] -> hcell_count() < 10 || envs[i] -> tick > max_tick;
+}
+
+/**
+ * Compute the reward of a treatment step, following CellEnvironment.adjust_reward
+ */
+double VecController::adjust_reward(int i, double dose, int pre_ccell, int post_ccell, int pre_hcell, int p_hcell,
+                                    int post_hcell){
+    int ccell_killed = pre_ccell - post_ccell;
+    int hcells_lost = pre_hcell - std::min(post_hcell, p_hcell);
+    if (special_reward && done[i]){
+        if (envs[i] -> ccell_count() > 0) // The episode ended because of a loss or a time out
+            return -1.0;
+        return 0.5 - (double) (init_hcell_count[i] - envs[i] -> hcell_count()) / 3000.0;
+    }
+    if (reward == 'k')
+        return (double) (ccell_killed - 5 * hcells_lost) / 100000.0;
+    return - dose / 200.0 + (double) (ccell_killed - 5 * hcells_lost) / 100000.0;
+}
@@ -0,0 +1,48 @@
+#ifndef RADIO_RL_VEC_CONTROLLER_H
+#define RADIO_RL_VEC_CONTROLLER_H
+
+#include "controller.h"
+#include "thread_pool.h"
+
+/**
+ * A batch of independent simulations stepped together
+ *
+ * Each environment follows the same protocol as CellEnvironment in model_env_cpp.py: one irradiation followed by a
+ * number of hours of rest per step, with the reward and terminal conditions computed in C++. Observations are the agent
+ * state of Controller::observe_state, as float or as bytes, with the same scales for the whole batch.
+ */
+class VecController {
+public:
+    VecController(int num_envs, int xsize, int ysize, int sources_num, int init_steps, char reward,
+                  bool special_reward, int max_tick, unsigned int seed, int num_threads, const double * scales,
+                  bool byte_observations);
+    ~VecController();
+    void step(const double * doses, const int * rest_hours, void * observations, double * rewards, bool * terminals);
+    void reset(const int * indices, int count, void * observations);
+    void observe(void * observations);
+    Controller * get(int i);
+    int num_envs;
+    int xsize, ysize;
+    bool byte_observations; // true for observations of unsigned char, false for float
+private:
+    void reset_env(int i, unsigned int seed);
+    void observe_env(int i, void * observations);
+    void step_env(int i, double dose, int rest);
+    bool in_terminal_state(int i);
+    double adjust_reward(int i, double dose, int pre_ccell, int post_ccell, int pre_hcell, int p_hcell, int post_hcell);
+    Controller ** envs;
+    int * init_hcell_count;
+    bool * done;
+    double * last_rewards;
+    int sources_num;
+    int init_steps;
+    char reward;
+    bool special_reward;
+    int max_tick;
+    double scales[3]; // Factors of the channels of the observations
+    unsigned int seed;
+    unsigned int episodes; // Number of episodes started by reset
+    ThreadPool pool;
+};
+
+#endif //RADIO_RL_VEC_CONTROLLER_H